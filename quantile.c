@@ -12,12 +12,22 @@
 #include <limits.h>
 
 #include "postgres.h"
+#include "access/htup_details.h"
+#include "funcapi.h"
 #include "utils/array.h"
 #include "utils/lsyscache.h"
 #include "utils/numeric.h"
 #include "utils/builtins.h"
 #include "catalog/pg_type.h"
 #include "nodes/execnodes.h"
+#include "libpq/pqformat.h"
+#include "storage/buffile.h"
+#include "utils/guc.h"
+#include "storage/itemptr.h"
+
+#if (PG_VERSION_NUM >= 150000)
+#include "common/pg_prng.h"
+#endif
 
 #ifdef PG_MODULE_MAGIC
 PG_MODULE_MAGIC;
@@ -74,6 +84,65 @@ PG_MODULE_MAGIC;
 
 #endif
 
+#if (PG_VERSION_NUM < 110000)
+#define pq_sendint32(buf, i)	pq_sendint(buf, i, 4)
+#endif
+
+/*
+ * Spilled values (int64 and double only). All the values are written
+ * to a temporary file as order-preserving uint64 keys, and we only keep
+ * counts for coarse radix buckets (the top nbits bits of the key) in
+ * memory. The final function then refines the buckets that contain the
+ * requested ranks, re-reading the file as needed.
+ *
+ * The number of bits depends on quantile.spill_mem - the elements array
+ * gets half of the limit, and the other half is shared by the bucket
+ * counts, the counts of the refined bucket and the buffer for reading
+ * the file (see spill_quantile).
+ */
+#define QUANTILE_SPILL_MIN_BITS	4
+#define QUANTILE_SPILL_MAX_BITS	16
+
+typedef struct quantile_spill
+{
+	BufFile	   *file;		/* temporary file with the spilled keys */
+	int64		nkeys;		/* number of keys in the file */
+
+	int			nbits;		/* bits per level of buckets */
+	int64	   *counts;		/* counts for the top nbits bits of the keys */
+} quantile_spill;
+
+/*
+ * Reservoir sampling (quantile_sampled aggregates), using Algorithm L.
+ * The reservoir is kept in the regular 'elements' array, limited to
+ * samplesize values. Once it's full, instead of generating a random
+ * number for each row we compute how many rows to skip before the next
+ * replacement, so most rows only increment the counter.
+ */
+typedef struct quantile_sampler
+{
+	int		samplesize;	/* maximum number of sampled values */
+	int64	nseen;		/* number of values seen (including skipped ones) */
+	int64	nextsample;	/* value to put into the reservoir next (1-based) */
+	double	W;			/* Algorithm L state */
+	uint64	rngstate;	/* state of the splitmix64 generator */
+} quantile_sampler;
+
+/*
+ * Sorted run of values, received from a parallel worker. The combine
+ * function does not merge the runs (or concatenate and sort them again),
+ * it only keeps a list - the final function then selects the requested
+ * ranks from all the runs at once, using binary searches.
+ *
+ * The quantile aggregates also build runs while accumulating the values,
+ * by sorting blocks of QUANTILE_BLOCK_ELEMENTS values (see state_sort_block).
+ */
+typedef struct quantile_run
+{
+	int		nelements;	/* number of values in the run */
+	void   *elements;	/* sorted values */
+} quantile_run;
+
 /*
  * Structures used to keep the data - the 'elements' array is extended
  * on the fly if needed.
@@ -87,16 +156,174 @@ typedef struct quantile_state
 	/* arrays of elements and requested quantiles */
 	double *quantiles;
 	void   *elements;
+
+	/* spilled values (NULL until quantile.spill_mem gets exceeded) */
+	quantile_spill *spill;
+
+	/* may be spilled (int64/double quantile aggregates, see quantile_make_room) */
+	bool	spillable;
+
+	/* built by a parallel worker, i.e. going to be serialized (not spilled) */
+	bool	partial;
+
+	/* aggregate context, so that we don't need to look it up for each row */
+	MemoryContext	aggcontext;
+
+	/* reservoir sampling (quantile_sampled only) */
+	quantile_sampler *sampler;
+
+	/* sorted runs of values from combined partial states */
+	int		nruns;
+	int		maxruns;
+	quantile_run *runs;
+
+	/* thresholds for the rank aggregates (same type as elements) */
+	int		nthresholds;
+	void   *thresholds;
+
+	/* number of buckets for the equi-depth histogram aggregates */
+	int		nbuckets;
 } quantile_state;
 
+/*
+ * State for the quantile_columns aggregate, computing the same quantiles
+ * for multiple columns at once. Each column has a separate buffer of
+ * values (so each of them can be sorted on its own), but all of them are
+ * appended to in a single transition call. NULL values are ignored, so
+ * the columns may have different numbers of values.
+ */
+typedef struct quantile_columns_state
+{
+	int		nquantiles;		/* size of the quantiles array */
+	double *quantiles;
+
+	int		ncolumns;		/* number of columns (values in each row) */
+	int	   *nelements;		/* number of values in each column */
+	int	   *maxelements;	/* size of each column buffer */
+	double **columns;		/* values of each column */
+} quantile_columns_state;
+
 #define	QUANTILE_MIN_ELEMENTS	4
 
+/*
+ * Values are sorted in blocks of this size while being accumulated (so
+ * that the block is still in the CPU cache), 64kB for int64/double.
+ */
+#define QUANTILE_BLOCK_ELEMENTS	8192
+
+/* quantiles this close to 0 or 1 are selected using a heap (tail_select) */
+#define QUANTILE_TAIL_FRACTION	0.05
+
+/* fraction of values trimmed at each end for the trimmed mean */
+#define QUANTILE_TRIM_FRACTION	0.05
+
+/* data types supported by the aggregates (stored in the eps state) */
+#define QUANTILE_TYPE_INT32		1
+#define QUANTILE_TYPE_INT64		2
+#define QUANTILE_TYPE_DOUBLE	3
+#define QUANTILE_TYPE_NUMERIC	4
+
+/*
+ * Greenwald-Khanna summary, used by the quantile_eps aggregates. Each
+ * tuple represents a value with rmin(i) = sum(g) for tuples up to i and
+ * rmax(i) = rmin(i) + delta. As long as (g + delta) <= 2 * epsilon * n
+ * for all tuples, any rank can be answered with error <= epsilon * n.
+ * That's a deterministic guarantee, and it's preserved by merging two
+ * summaries (which we rely on in the combine function).
+ *
+ * New values are collected in a buffer first, and then added to the
+ * summary in batches (sort + merge + compress), which is much cheaper
+ * than inserting values one by one.
+ */
+typedef struct gk_tuple
+{
+	int64	g;		/* rmin(i) - rmin(i-1) */
+	int64	delta;	/* rmax(i) - rmin(i) */
+} gk_tuple;
+
+typedef struct quantile_eps_state
+{
+	int		type;			/* QUANTILE_TYPE_* */
+	double	epsilon;		/* maximum rank error (fraction of count) */
+
+	int		nquantiles;		/* size of the quantiles array */
+	double *quantiles;
+
+	int64	count;			/* number of values in the summary */
+
+	int		ntuples;		/* number of tuples in the summary */
+	int		maxtuples;		/* size of the values/tuples arrays */
+	void   *values;			/* tuple values (sorted) */
+	gk_tuple *tuples;
+
+	int		nbuffered;		/* number of buffered values */
+	int		maxbuffered;	/* size of the buffer */
+	void   *buffer;			/* values not added to the summary yet */
+
+	/* context the summary was allocated in (for copies of numeric values) */
+	MemoryContext	context;
+} quantile_eps_state;
+
+#define QUANTILE_EPS_MIN_BUFFER	1024
+#define QUANTILE_EPS_MAX_BUFFER	65536
+
+/*
+ * Format of the storable states (quantile_state_agg etc.), the values are
+ * delta encoded (see send_sorted_values).
+ */
+#define QUANTILE_STATE_FORMAT	1
+
+/* format of the storable quantile sketches (quantile_sketch_agg etc.) */
+#define QUANTILE_SKETCH_FORMAT	1
+
+/* number of values encoded between resizing the output buffer */
+#define QUANTILE_ENCODE_CHUNK	1024
+
+/* number of keys read from the spill file at once (at least) */
+#define QUANTILE_SPILL_CHUNK	8192
+
+/* memory limit (in kB) for int64/double states, 0 means no limit */
+static int	quantile_spill_mem = 0;
+
+/*
+ * Algorithms used to sort (or select from) int32/int64/double values,
+ * see quantile_sort and quantile_select. With "auto" the algorithm is
+ * picked based on the data, the other values force a particular one
+ * (when applicable), which is useful mostly for benchmarking.
+ */
+#define QUANTILE_SORT_AUTO		0
+#define QUANTILE_SORT_QSORT		1
+#define QUANTILE_SORT_COUNTING	2
+#define QUANTILE_SORT_RADIX		3
+#define QUANTILE_SORT_SELECT	4
+
+static const struct config_enum_entry quantile_sort_methods[] = {
+	{"auto", QUANTILE_SORT_AUTO, false},
+	{"qsort", QUANTILE_SORT_QSORT, false},
+	{"counting", QUANTILE_SORT_COUNTING, false},
+	{"radix", QUANTILE_SORT_RADIX, false},
+	{"select", QUANTILE_SORT_SELECT, false},
+	{NULL, 0, false}
+};
+
+static int	quantile_sort_method = QUANTILE_SORT_AUTO;
+
+/* counting sort is used for ranges of keys up to this size */
+#define QUANTILE_COUNTING_RANGE	65536
+
+/* radix sort is used for arrays with at least this many values */
+#define QUANTILE_RADIX_MIN		1024
+
+void		_PG_init(void);
+
 /* comparators, used for qsort */
 
 static int  double_comparator(const void *a, const void *b);
 static int  int32_comparator(const void *a, const void *b);
 static int  int64_comparator(const void *a, const void *b);
 static int  numeric_comparator(const void *a, const void *b);
+static int  uint32_comparator(const void *a, const void *b);
+static int  uint64_comparator(const void *a, const void *b);
 
 /* parse the quantiles array */
 static double *
@@ -117,6 +344,265 @@ numeric_to_array(FunctionCallInfo fcinfo, Numeric * d, int len);
 static void
 check_quantiles(int nquantiles, double * quantiles);
 
+static Size
+quantile_type_size(int type);
+
+static int
+(*quantile_type_comparator(int type)) (const void *a, const void *b);
+
+static void
+quantile_sort(void *elements, int nelements, int type);
+
+static bool
+quantile_select(void *elements, int nelements, int type, double quantile,
+				char *result);
+
+static void *
+array_to_elements(ArrayType *array, int type, int *len);
+
+static Datum
+elements_to_array(FunctionCallInfo fcinfo, int type, void *elements, int len);
+
+static quantile_state *
+state_alloc(int type, MemoryContext aggcontext, int maxelements,
+			bool spillable);
+
+static void
+state_grow(quantile_state *state, Size elsize, int64 nelements);
+
+static void
+state_append_datum(quantile_state *state, int type, Datum value);
+
+static void
+state_set_datum(quantile_state *state, int type, int idx, Datum value);
+
+static char *
+array_values(ArrayType *array, int type, int *len);
+
+static void
+state_append_values(quantile_state *state, int type, char *values, int nvalues);
+
+/* sorted runs (combined partial states) */
+static void
+state_add_run(quantile_state *state, void *elements, int nelements);
+
+static void
+state_sort_block(quantile_state *state, int type);
+
+static void
+merge_runs(char *a, int na, char *b, int nb, char *result, int type);
+
+static void
+state_runs_quantiles(quantile_state *state, int type, char *result);
+
+static char *
+state_sorted_values(quantile_state *state, int type, int *len);
+
+static void
+merge_sift_down(int *heap, int nheap, int j, char **runs, int *positions,
+				Size elsize, int (*cmp) (const void *a, const void *b));
+
+static void
+send_element(StringInfo buf, int type, char *element);
+
+static void
+recv_element(StringInfo buf, int type, char *element);
+
+static void
+send_sorted_values(StringInfo buf, int type, char *values, int nvalues);
+
+static void
+reserve_serialized(StringInfo buf, Size len);
+
+static void
+recv_sorted_values(StringInfo buf, int type, char *values, int nvalues);
+
+/* storable states */
+static bytea *
+stored_state_encode(int type, char *values, int nvalues);
+
+static char *
+stored_state_decode(bytea *stored, int type, int *len);
+
+static Numeric
+recv_stored_numeric(StringInfo buf);
+
+/* storable sketches */
+static bytea *
+sketch_encode(quantile_eps_state *state);
+
+static quantile_eps_state *
+sketch_decode(bytea *sketch, int type);
+
+/* deduplication of sorted values (quantile_distinct) */
+static int
+distinct_compact(char *values, int nvalues, int type, bool free_values);
+
+/* multiple columns at once (quantile_columns) */
+static quantile_columns_state *
+columns_state_create(int ncolumns, int nquantiles, double *quantiles);
+
+static void
+columns_grow(quantile_columns_state *state, int column, int64 nelements);
+
+/* robust statistics (quantile_robust_stats) */
+static double *
+values_to_double(char *values, int nvalues, int type);
+
+/* sorting and selection kernels (wide means 64-bit keys) */
+static void
+elements_to_keys(void *elements, int nelements, int type);
+
+static void
+keys_to_elements(void *elements, int nelements, int type);
+
+static bool
+keys_range(void *keys, int nkeys, bool wide, uint64 *min, uint64 *max);
+
+static void
+counting_sort_keys(void *keys, int nkeys, bool wide, uint64 min, uint64 max);
+
+static void
+radix_sort_keys(void *keys, int nkeys, bool wide, uint64 min, uint64 max);
+
+static uint64
+select_key(void *data, int nkeys, bool wide, int k);
+
+/* selection of extreme quantiles */
+static bool
+tail_select(void *elements, int nelements, int type, double quantile,
+			char *result);
+
+static void
+tail_sift_down(char *heap, int nheap, int i, Size elsize, bool top,
+			   int (*cmp) (const void *a, const void *b));
+
+/* reservoir sampling */
+static double
+sampler_random(quantile_sampler *sampler);
+
+static uint64
+sampler_random_uint64(quantile_sampler *sampler);
+
+static void
+sampler_skip(quantile_sampler *sampler);
+
+/* Greenwald-Khanna summaries */
+static quantile_eps_state *
+eps_state_create(FunctionCallInfo fcinfo, int type);
+
+static quantile_eps_state *
+eps_state_alloc(int type, double epsilon);
+
+static void
+eps_state_reserve(quantile_eps_state *state, int ntuples);
+
+static void
+eps_state_free(quantile_eps_state *state);
+
+static void
+eps_state_add(quantile_eps_state *state, void *value);
+
+static void
+eps_state_flush(quantile_eps_state *state);
+
+static void
+eps_state_query(quantile_eps_state *state, void *result);
+
+static quantile_eps_state *
+eps_state_merge(quantile_eps_state *a, quantile_eps_state *b);
+
+/* spilling of int64/double values to a temporary file */
+static bool
+partial_aggregate(FunctionCallInfo fcinfo);
+
+static void
+quantile_make_room(quantile_state *state, bool isdouble);
+
+static void
+spill_elements(quantile_state *state, bool isdouble);
+
+static void
+spill_keys(quantile_state *state, bool isdouble, uint64 *keys, int nkeys);
+
+static void
+spill_runs(quantile_state *state, bool isdouble);
+
+static void
+spill_copy(quantile_state *state, quantile_state *src, bool isdouble);
+
+static uint64
+spill_quantile(quantile_state *state, double quantile, bool isdouble);
+
+static void
+spill_read(BufFile *file, void *data, Size len);
+
+static void
+spill_seek(quantile_spill *spill, int64 nkeys);
+
+/*
+ * Order-preserving mapping of int32/int64/double values to uint32/uint64
+ * keys. For integers the sign bit gets flipped. For doubles, negative
+ * values get all bits flipped and positive values get the sign bit
+ * flipped. NaN is mapped to the largest key, i.e. it sorts
+ * after all other values (including infinity) just like in PostgreSQL.
+ */
+static inline uint32
+int32_to_key(int32 value)
+{
+	return ((uint32) value) ^ ((uint32) 1 << 31);
+}
+
+static inline int32
+key_to_int32(uint32 key)
+{
+	return (int32) (key ^ ((uint32) 1 << 31));
+}
+
+static inline uint64
+int64_to_key(int64 value)
+{
+	return ((uint64) value) ^ (UINT64CONST(1) << 63);
+}
+
+static inline int64
+key_to_int64(uint64 key)
+{
+	return (int64) (key ^ (UINT64CONST(1) << 63));
+}
+
+static inline uint64
+double_to_key(double value)
+{
+	uint64	bits;
+
+	if (isnan(value))
+		return ~UINT64CONST(0);
+
+	memcpy(&bits, &value, sizeof(uint64));
+
+	if (bits & (UINT64CONST(1) << 63))
+		return ~bits;
+
+	return bits | (UINT64CONST(1) << 63);
+}
+
+static inline double
+key_to_double(uint64 key)
+{
+	uint64	bits;
+	double	value;
+
+	if (key & (UINT64CONST(1) << 63))
+		bits = key ^ (UINT64CONST(1) << 63);
+	else
+		bits = ~key;
+
+	memcpy(&value, &bits, sizeof(double));
+
+	return value;
+}
+
 /* prototypes */
 PG_FUNCTION_INFO_V1(quantile_append_double_array);
 PG_FUNCTION_INFO_V1(quantile_append_double);
@@ -166,17 +652,361 @@ Datum quantile_append_numeric(PG_FUNCTION_ARGS);
 Datum quantile_numeric_array(PG_FUNCTION_ARGS);
 Datum quantile_numeric(PG_FUNCTION_ARGS);
 
+PG_FUNCTION_INFO_V1(quantile_eps_append_double);
+PG_FUNCTION_INFO_V1(quantile_eps_append_int32);
+PG_FUNCTION_INFO_V1(quantile_eps_append_int64);
+PG_FUNCTION_INFO_V1(quantile_eps_append_numeric);
+
+PG_FUNCTION_INFO_V1(quantile_eps_double);
+PG_FUNCTION_INFO_V1(quantile_eps_int32);
+PG_FUNCTION_INFO_V1(quantile_eps_int64);
+PG_FUNCTION_INFO_V1(quantile_eps_numeric);
+
+PG_FUNCTION_INFO_V1(quantile_eps_combine);
+PG_FUNCTION_INFO_V1(quantile_eps_serialize);
+PG_FUNCTION_INFO_V1(quantile_eps_deserialize);
+
+Datum quantile_eps_append_double(PG_FUNCTION_ARGS);
+Datum quantile_eps_append_int32(PG_FUNCTION_ARGS);
+Datum quantile_eps_append_int64(PG_FUNCTION_ARGS);
+Datum quantile_eps_append_numeric(PG_FUNCTION_ARGS);
+
+Datum quantile_eps_double(PG_FUNCTION_ARGS);
+Datum quantile_eps_int32(PG_FUNCTION_ARGS);
+Datum quantile_eps_int64(PG_FUNCTION_ARGS);
+Datum quantile_eps_numeric(PG_FUNCTION_ARGS);
+
+Datum quantile_eps_combine(PG_FUNCTION_ARGS);
+Datum quantile_eps_serialize(PG_FUNCTION_ARGS);
+Datum quantile_eps_deserialize(PG_FUNCTION_ARGS);
+
+PG_FUNCTION_INFO_V1(quantile_rank_append_double);
+PG_FUNCTION_INFO_V1(quantile_rank_append_int32);
+PG_FUNCTION_INFO_V1(quantile_rank_append_int64);
+PG_FUNCTION_INFO_V1(quantile_rank_append_numeric);
+
+PG_FUNCTION_INFO_V1(quantile_and_rank_append_double);
+PG_FUNCTION_INFO_V1(quantile_and_rank_append_int32);
+PG_FUNCTION_INFO_V1(quantile_and_rank_append_int64);
+PG_FUNCTION_INFO_V1(quantile_and_rank_append_numeric);
+
+PG_FUNCTION_INFO_V1(quantile_rank_double);
+PG_FUNCTION_INFO_V1(quantile_rank_int32);
+PG_FUNCTION_INFO_V1(quantile_rank_int64);
+PG_FUNCTION_INFO_V1(quantile_rank_numeric);
+
+PG_FUNCTION_INFO_V1(quantile_and_rank_double);
+PG_FUNCTION_INFO_V1(quantile_and_rank_int32);
+PG_FUNCTION_INFO_V1(quantile_and_rank_int64);
+PG_FUNCTION_INFO_V1(quantile_and_rank_numeric);
+
+Datum quantile_rank_append_double(PG_FUNCTION_ARGS);
+Datum quantile_rank_append_int32(PG_FUNCTION_ARGS);
+Datum quantile_rank_append_int64(PG_FUNCTION_ARGS);
+Datum quantile_rank_append_numeric(PG_FUNCTION_ARGS);
+
+Datum quantile_and_rank_append_double(PG_FUNCTION_ARGS);
+Datum quantile_and_rank_append_int32(PG_FUNCTION_ARGS);
+Datum quantile_and_rank_append_int64(PG_FUNCTION_ARGS);
+Datum quantile_and_rank_append_numeric(PG_FUNCTION_ARGS);
+
+Datum quantile_rank_double(PG_FUNCTION_ARGS);
+Datum quantile_rank_int32(PG_FUNCTION_ARGS);
+Datum quantile_rank_int64(PG_FUNCTION_ARGS);
+Datum quantile_rank_numeric(PG_FUNCTION_ARGS);
+
+Datum quantile_and_rank_double(PG_FUNCTION_ARGS);
+Datum quantile_and_rank_int32(PG_FUNCTION_ARGS);
+Datum quantile_and_rank_int64(PG_FUNCTION_ARGS);
+Datum quantile_and_rank_numeric(PG_FUNCTION_ARGS);
+
+PG_FUNCTION_INFO_V1(quantile_buckets_append_double);
+PG_FUNCTION_INFO_V1(quantile_buckets_append_int32);
+PG_FUNCTION_INFO_V1(quantile_buckets_append_int64);
+PG_FUNCTION_INFO_V1(quantile_buckets_append_numeric);
+
+PG_FUNCTION_INFO_V1(quantile_buckets_double);
+PG_FUNCTION_INFO_V1(quantile_buckets_int32);
+PG_FUNCTION_INFO_V1(quantile_buckets_int64);
+PG_FUNCTION_INFO_V1(quantile_buckets_numeric);
+
+Datum quantile_buckets_append_double(PG_FUNCTION_ARGS);
+Datum quantile_buckets_append_int32(PG_FUNCTION_ARGS);
+Datum quantile_buckets_append_int64(PG_FUNCTION_ARGS);
+Datum quantile_buckets_append_numeric(PG_FUNCTION_ARGS);
+
+Datum quantile_buckets_double(PG_FUNCTION_ARGS);
+Datum quantile_buckets_int32(PG_FUNCTION_ARGS);
+Datum quantile_buckets_int64(PG_FUNCTION_ARGS);
+Datum quantile_buckets_numeric(PG_FUNCTION_ARGS);
+
+PG_FUNCTION_INFO_V1(quantile_sampled_append_double);
+PG_FUNCTION_INFO_V1(quantile_sampled_append_int32);
+PG_FUNCTION_INFO_V1(quantile_sampled_append_int64);
+PG_FUNCTION_INFO_V1(quantile_sampled_append_numeric);
+
+PG_FUNCTION_INFO_V1(quantile_sampled_double);
+PG_FUNCTION_INFO_V1(quantile_sampled_int32);
+PG_FUNCTION_INFO_V1(quantile_sampled_int64);
+PG_FUNCTION_INFO_V1(quantile_sampled_numeric);
+
+Datum quantile_sampled_append_double(PG_FUNCTION_ARGS);
+Datum quantile_sampled_append_int32(PG_FUNCTION_ARGS);
+Datum quantile_sampled_append_int64(PG_FUNCTION_ARGS);
+Datum quantile_sampled_append_numeric(PG_FUNCTION_ARGS);
+
+Datum quantile_sampled_double(PG_FUNCTION_ARGS);
+Datum quantile_sampled_int32(PG_FUNCTION_ARGS);
+Datum quantile_sampled_int64(PG_FUNCTION_ARGS);
+Datum quantile_sampled_numeric(PG_FUNCTION_ARGS);
+
+PG_FUNCTION_INFO_V1(quantile_array_agg_append_double);
+PG_FUNCTION_INFO_V1(quantile_array_agg_append_int32);
+PG_FUNCTION_INFO_V1(quantile_array_agg_append_int64);
+
+PG_FUNCTION_INFO_V1(array_quantile_double);
+PG_FUNCTION_INFO_V1(array_quantile_int32);
+PG_FUNCTION_INFO_V1(array_quantile_int64);
+
+Datum quantile_array_agg_append_double(PG_FUNCTION_ARGS);
+Datum quantile_array_agg_append_int32(PG_FUNCTION_ARGS);
+Datum quantile_array_agg_append_int64(PG_FUNCTION_ARGS);
+
+Datum array_quantile_double(PG_FUNCTION_ARGS);
+Datum array_quantile_int32(PG_FUNCTION_ARGS);
+Datum array_quantile_int64(PG_FUNCTION_ARGS);
+
+PG_FUNCTION_INFO_V1(quantile_combine_double);
+PG_FUNCTION_INFO_V1(quantile_combine_int32);
+PG_FUNCTION_INFO_V1(quantile_combine_int64);
+PG_FUNCTION_INFO_V1(quantile_combine_numeric);
+
+PG_FUNCTION_INFO_V1(quantile_serialize_double);
+PG_FUNCTION_INFO_V1(quantile_serialize_int32);
+PG_FUNCTION_INFO_V1(quantile_serialize_int64);
+PG_FUNCTION_INFO_V1(quantile_serialize_numeric);
+
+PG_FUNCTION_INFO_V1(quantile_deserialize_double);
+PG_FUNCTION_INFO_V1(quantile_deserialize_int32);
+PG_FUNCTION_INFO_V1(quantile_deserialize_int64);
+PG_FUNCTION_INFO_V1(quantile_deserialize_numeric);
+
+Datum quantile_combine_double(PG_FUNCTION_ARGS);
+Datum quantile_combine_int32(PG_FUNCTION_ARGS);
+Datum quantile_combine_int64(PG_FUNCTION_ARGS);
+Datum quantile_combine_numeric(PG_FUNCTION_ARGS);
+
+Datum quantile_serialize_double(PG_FUNCTION_ARGS);
+Datum quantile_serialize_int32(PG_FUNCTION_ARGS);
+Datum quantile_serialize_int64(PG_FUNCTION_ARGS);
+Datum quantile_serialize_numeric(PG_FUNCTION_ARGS);
+
+Datum quantile_deserialize_double(PG_FUNCTION_ARGS);
+Datum quantile_deserialize_int32(PG_FUNCTION_ARGS);
+Datum quantile_deserialize_int64(PG_FUNCTION_ARGS);
+Datum quantile_deserialize_numeric(PG_FUNCTION_ARGS);
+
+PG_FUNCTION_INFO_V1(quantile_state_agg_append_double);
+PG_FUNCTION_INFO_V1(quantile_state_agg_append_int32);
+PG_FUNCTION_INFO_V1(quantile_state_agg_append_int64);
+PG_FUNCTION_INFO_V1(quantile_state_agg_append_numeric);
+
+PG_FUNCTION_INFO_V1(quantile_state_agg_double);
+PG_FUNCTION_INFO_V1(quantile_state_agg_int32);
+PG_FUNCTION_INFO_V1(quantile_state_agg_int64);
+PG_FUNCTION_INFO_V1(quantile_state_agg_numeric);
+
+PG_FUNCTION_INFO_V1(quantile_merge_append_double);
+PG_FUNCTION_INFO_V1(quantile_merge_append_int32);
+PG_FUNCTION_INFO_V1(quantile_merge_append_int64);
+PG_FUNCTION_INFO_V1(quantile_merge_append_numeric);
+
+Datum quantile_state_agg_append_double(PG_FUNCTION_ARGS);
+Datum quantile_state_agg_append_int32(PG_FUNCTION_ARGS);
+Datum quantile_state_agg_append_int64(PG_FUNCTION_ARGS);
+Datum quantile_state_agg_append_numeric(PG_FUNCTION_ARGS);
+
+Datum quantile_state_agg_double(PG_FUNCTION_ARGS);
+Datum quantile_state_agg_int32(PG_FUNCTION_ARGS);
+Datum quantile_state_agg_int64(PG_FUNCTION_ARGS);
+Datum quantile_state_agg_numeric(PG_FUNCTION_ARGS);
+
+Datum quantile_merge_append_double(PG_FUNCTION_ARGS);
+Datum quantile_merge_append_int32(PG_FUNCTION_ARGS);
+Datum quantile_merge_append_int64(PG_FUNCTION_ARGS);
+Datum quantile_merge_append_numeric(PG_FUNCTION_ARGS);
+
+PG_FUNCTION_INFO_V1(quantile_state_add_double);
+PG_FUNCTION_INFO_V1(quantile_state_add_int32);
+PG_FUNCTION_INFO_V1(quantile_state_add_int64);
+PG_FUNCTION_INFO_V1(quantile_state_add_numeric);
+
+PG_FUNCTION_INFO_V1(quantile_state_remove_double);
+PG_FUNCTION_INFO_V1(quantile_state_remove_int32);
+PG_FUNCTION_INFO_V1(quantile_state_remove_int64);
+PG_FUNCTION_INFO_V1(quantile_state_remove_numeric);
+
+PG_FUNCTION_INFO_V1(quantile_state_get_double);
+PG_FUNCTION_INFO_V1(quantile_state_get_int32);
+PG_FUNCTION_INFO_V1(quantile_state_get_int64);
+PG_FUNCTION_INFO_V1(quantile_state_get_numeric);
+
+Datum quantile_state_add_double(PG_FUNCTION_ARGS);
+Datum quantile_state_add_int32(PG_FUNCTION_ARGS);
+Datum quantile_state_add_int64(PG_FUNCTION_ARGS);
+Datum quantile_state_add_numeric(PG_FUNCTION_ARGS);
+
+Datum quantile_state_remove_double(PG_FUNCTION_ARGS);
+Datum quantile_state_remove_int32(PG_FUNCTION_ARGS);
+Datum quantile_state_remove_int64(PG_FUNCTION_ARGS);
+Datum quantile_state_remove_numeric(PG_FUNCTION_ARGS);
+
+Datum quantile_state_get_double(PG_FUNCTION_ARGS);
+Datum quantile_state_get_int32(PG_FUNCTION_ARGS);
+Datum quantile_state_get_int64(PG_FUNCTION_ARGS);
+Datum quantile_state_get_numeric(PG_FUNCTION_ARGS);
+
+PG_FUNCTION_INFO_V1(quantile_distinct_append_double);
+PG_FUNCTION_INFO_V1(quantile_distinct_append_int32);
+PG_FUNCTION_INFO_V1(quantile_distinct_append_int64);
+PG_FUNCTION_INFO_V1(quantile_distinct_append_numeric);
+
+PG_FUNCTION_INFO_V1(quantile_distinct_double);
+PG_FUNCTION_INFO_V1(quantile_distinct_int32);
+PG_FUNCTION_INFO_V1(quantile_distinct_int64);
+PG_FUNCTION_INFO_V1(quantile_distinct_numeric);
+
+Datum quantile_distinct_append_double(PG_FUNCTION_ARGS);
+Datum quantile_distinct_append_int32(PG_FUNCTION_ARGS);
+Datum quantile_distinct_append_int64(PG_FUNCTION_ARGS);
+Datum quantile_distinct_append_numeric(PG_FUNCTION_ARGS);
+
+Datum quantile_distinct_double(PG_FUNCTION_ARGS);
+Datum quantile_distinct_int32(PG_FUNCTION_ARGS);
+Datum quantile_distinct_int64(PG_FUNCTION_ARGS);
+Datum quantile_distinct_numeric(PG_FUNCTION_ARGS);
+
+PG_FUNCTION_INFO_V1(quantile_columns_append);
+PG_FUNCTION_INFO_V1(quantile_columns_final);
+PG_FUNCTION_INFO_V1(quantile_columns_combine);
+PG_FUNCTION_INFO_V1(quantile_columns_serialize);
+PG_FUNCTION_INFO_V1(quantile_columns_deserialize);
+
+Datum quantile_columns_append(PG_FUNCTION_ARGS);
+Datum quantile_columns_final(PG_FUNCTION_ARGS);
+Datum quantile_columns_combine(PG_FUNCTION_ARGS);
+Datum quantile_columns_serialize(PG_FUNCTION_ARGS);
+Datum quantile_columns_deserialize(PG_FUNCTION_ARGS);
+
+PG_FUNCTION_INFO_V1(quantile_sketch_final);
+PG_FUNCTION_INFO_V1(quantile_sketch_merge_append_double);
+PG_FUNCTION_INFO_V1(quantile_sketch_merge_append_int32);
+PG_FUNCTION_INFO_V1(quantile_sketch_merge_append_int64);
+PG_FUNCTION_INFO_V1(quantile_sketch_merge_append_numeric);
+PG_FUNCTION_INFO_V1(quantile_sketch_combine_double);
+PG_FUNCTION_INFO_V1(quantile_sketch_combine_int32);
+PG_FUNCTION_INFO_V1(quantile_sketch_combine_int64);
+PG_FUNCTION_INFO_V1(quantile_sketch_combine_numeric);
+PG_FUNCTION_INFO_V1(quantile_block_range);
+
+Datum quantile_sketch_final(PG_FUNCTION_ARGS);
+Datum quantile_sketch_merge_append_double(PG_FUNCTION_ARGS);
+Datum quantile_sketch_merge_append_int32(PG_FUNCTION_ARGS);
+Datum quantile_sketch_merge_append_int64(PG_FUNCTION_ARGS);
+Datum quantile_sketch_merge_append_numeric(PG_FUNCTION_ARGS);
+Datum quantile_sketch_combine_double(PG_FUNCTION_ARGS);
+Datum quantile_sketch_combine_int32(PG_FUNCTION_ARGS);
+Datum quantile_sketch_combine_int64(PG_FUNCTION_ARGS);
+Datum quantile_sketch_combine_numeric(PG_FUNCTION_ARGS);
+Datum quantile_block_range(PG_FUNCTION_ARGS);
+
+PG_FUNCTION_INFO_V1(quantile_robust_stats_double);
+PG_FUNCTION_INFO_V1(quantile_robust_stats_int32);
+PG_FUNCTION_INFO_V1(quantile_robust_stats_int64);
+PG_FUNCTION_INFO_V1(quantile_robust_stats_numeric);
+PG_FUNCTION_INFO_V1(quantile_state_robust_stats_double);
+PG_FUNCTION_INFO_V1(quantile_state_robust_stats_int32);
+PG_FUNCTION_INFO_V1(quantile_state_robust_stats_int64);
+PG_FUNCTION_INFO_V1(quantile_state_robust_stats_numeric);
+
+Datum quantile_robust_stats_double(PG_FUNCTION_ARGS);
+Datum quantile_robust_stats_int32(PG_FUNCTION_ARGS);
+Datum quantile_robust_stats_int64(PG_FUNCTION_ARGS);
+Datum quantile_robust_stats_numeric(PG_FUNCTION_ARGS);
+Datum quantile_state_robust_stats_double(PG_FUNCTION_ARGS);
+Datum quantile_state_robust_stats_int32(PG_FUNCTION_ARGS);
+Datum quantile_state_robust_stats_int64(PG_FUNCTION_ARGS);
+Datum quantile_state_robust_stats_numeric(PG_FUNCTION_ARGS);
+
+void
+_PG_init(void)
+{
+	DefineCustomIntVariable("quantile.spill_mem",
+							"Sets the maximum memory used by a single int64/double quantile state.",
+							"Values exceeding the limit are spilled to a temporary file, "
+							"and exact quantiles are computed by histogram refinement. "
+							"Zero means no limit.",
+							&quantile_spill_mem,
+							0,
+							0, INT_MAX / 1024,
+							PGC_USERSET,
+							GUC_UNIT_KB,
+							NULL, NULL, NULL);
+
+	DefineCustomEnumVariable("quantile.sort_method",
+							 "Sets the algorithm used to sort int, bigint and double precision values.",
+							 "The default (auto) picks the algorithm based on the data, "
+							 "the other values force qsort, counting sort, radix sort or "
+							 "selection of single quantiles (when applicable).",
+							 &quantile_sort_method,
+							 QUANTILE_SORT_AUTO,
+							 quantile_sort_methods,
+							 PGC_USERSET,
+							 0,
+							 NULL, NULL, NULL);
+
+#if (PG_VERSION_NUM >= 150000)
+	MarkGUCPrefixReserved("quantile");
+#else
+	EmitWarningsOnPlaceholders("quantile");
+#endif
+}
+
 static void
 AssertCheckQuantileState(quantile_state *state)
 {
 #ifdef USE_ASSERT_CHECKING
-	Assert(state->nquantiles >= 1);
+	Assert((state->nquantiles >= 1) || (state->thresholds != NULL) ||
+		   (state->nbuckets >= 1));
 
 	Assert(state->nelements >= 0);
 	Assert(state->nelements <= state->maxelements);
 #endif
 }
 
+/*
+ * Allocate a new state in the aggregate context, with an empty array for
+ * maxelements values of the given type. The quantiles (and the other
+ * fields specific to some of the aggregates) are left for the caller.
+ */
+static quantile_state *
+state_alloc(int type, MemoryContext aggcontext, int maxelements,
+			bool spillable)
+{
+	quantile_state *state;
+
+	state = (quantile_state *) MemoryContextAllocZero(aggcontext,
+													  sizeof(quantile_state));
+
+	state->elements = MemoryContextAlloc(aggcontext,
+										 maxelements * quantile_type_size(type));
+	state->maxelements = maxelements;
+	state->spillable = spillable;
+	state->aggcontext = aggcontext;
+
+	return state;
+}
+
 /*
  * The memory consumption might be a problem, as all the values are
  * kept in the memory - for example 1.000.000 of 8-byte values (bigint)
@@ -187,10 +1017,6 @@ Datum
 quantile_append_double(PG_FUNCTION_ARGS)
 {
 	quantile_state *state;
-
-	MemoryContext	oldcontext;
-	MemoryContext	aggcontext;
-
 	double		   *elements;
 
 	/* OK, we do want to skip NULL values altogether */
@@ -203,22 +1029,27 @@ quantile_append_double(PG_FUNCTION_ARGS)
 			PG_RETURN_DATUM(PG_GETARG_DATUM(0));
 	}
 
-	GET_AGG_CONTEXT("quantile_append_double", fcinfo, aggcontext);
-
-	oldcontext = MemoryContextSwitchTo(aggcontext);
-
 	if (PG_ARGISNULL(0))
 	{
-		state = (quantile_state *) palloc(sizeof(quantile_state));
-		state->elements  = palloc(QUANTILE_MIN_ELEMENTS * sizeof(double));
-		state->maxelements = QUANTILE_MIN_ELEMENTS;
-		state->nelements = 0;
+		MemoryContext	oldcontext;
+		MemoryContext	aggcontext;
+
+		/* only look up the aggregate context when creating the state */
+		GET_AGG_CONTEXT("quantile_append_double", fcinfo, aggcontext);
+
+		oldcontext = MemoryContextSwitchTo(aggcontext);
+
+		state = state_alloc(QUANTILE_TYPE_DOUBLE, aggcontext,
+							QUANTILE_MIN_ELEMENTS, true);
+		state->partial = partial_aggregate(fcinfo);
 
 		state->quantiles = (double *) palloc(sizeof(double));
 		state->quantiles[0] = PG_GETARG_FLOAT8(2);
 		state->nquantiles = 1;
 
 		check_quantiles(state->nquantiles, state->quantiles);
+
+		MemoryContextSwitchTo(oldcontext);
 	}
 	else
 		state = (quantile_state *) PG_GETARG_POINTER(0);
@@ -227,11 +1058,7 @@ quantile_append_double(PG_FUNCTION_ARGS)
 
 	/* we can be sure the value is not null (see the check above) */
 	if (state->nelements == state->maxelements)
-	{
-		state->maxelements *= 2;
-		state->elements = repalloc(state->elements,
-								   sizeof(double) * state->maxelements);
-	}
+		quantile_make_room(state, true);
 
 	Assert(state->nelements < state->maxelements);
 
@@ -239,8 +1066,6 @@ quantile_append_double(PG_FUNCTION_ARGS)
 	elements = (double *) state->elements;
 	elements[state->nelements++] = PG_GETARG_FLOAT8(1);
 
-	MemoryContextSwitchTo(oldcontext);
-
 	PG_RETURN_POINTER(state);
 }
 
@@ -248,12 +1073,7 @@ Datum
 quantile_append_double_array(PG_FUNCTION_ARGS)
 {
 	quantile_state *state;
-
-	MemoryContext	oldcontext;
-	MemoryContext	aggcontext;
-
 	double		   *elements;
-	ArrayType	   *quantiles;
 
 	/* OK, we do want to skip NULL values altogether */
 	if (PG_ARGISNULL(1))
@@ -265,24 +1085,27 @@ quantile_append_double_array(PG_FUNCTION_ARGS)
 			PG_RETURN_DATUM(PG_GETARG_DATUM(0));
 	}
 
-	quantiles = PG_GETARG_ARRAYTYPE_P(2);
+	if (PG_ARGISNULL(0))
+	{
+		MemoryContext	oldcontext;
+		MemoryContext	aggcontext;
 
-	GET_AGG_CONTEXT("quantile_append_double_array", fcinfo, aggcontext);
+		/* only look up the aggregate context when creating the state */
+		GET_AGG_CONTEXT("quantile_append_double_array", fcinfo, aggcontext);
 
-	oldcontext = MemoryContextSwitchTo(aggcontext);
+		oldcontext = MemoryContextSwitchTo(aggcontext);
 
-	if (PG_ARGISNULL(0))
-	{
-		state = (quantile_state *) palloc(sizeof(quantile_state));
-		state->elements  = palloc(QUANTILE_MIN_ELEMENTS * sizeof(double));
-		state->maxelements = QUANTILE_MIN_ELEMENTS;
-		state->nelements = 0;
+		state = state_alloc(QUANTILE_TYPE_DOUBLE, aggcontext,
+							QUANTILE_MIN_ELEMENTS, true);
+		state->partial = partial_aggregate(fcinfo);
 
 		/* read the array of quantiles */
-		state->quantiles = array_to_double(fcinfo, quantiles,
+		state->quantiles = array_to_double(fcinfo, PG_GETARG_ARRAYTYPE_P(2),
 										   &state->nquantiles);
 
 		check_quantiles(state->nquantiles, state->quantiles);
+
+		MemoryContextSwitchTo(oldcontext);
 	}
 	else
 		state = (quantile_state *) PG_GETARG_POINTER(0);
@@ -291,19 +1114,13 @@ quantile_append_double_array(PG_FUNCTION_ARGS)
 
 	/* we can be sure the value is not null (see the check above) */
 	if (state->nelements == state->maxelements)
-	{
-		state->maxelements *= 2;
-		state->elements = repalloc(state->elements,
-								   sizeof(double) * state->maxelements);
-	}
+		quantile_make_room(state, true);
 
 	Assert(state->nelements < state->maxelements);
 
 	elements = (double *) state->elements;
 	elements[state->nelements++] = PG_GETARG_FLOAT8(1);
 
-	MemoryContextSwitchTo(oldcontext);
-
 	PG_RETURN_POINTER(state);
 }
 
@@ -311,10 +1128,6 @@ Datum
 quantile_append_numeric(PG_FUNCTION_ARGS)
 {
 	quantile_state *state;
-
-	MemoryContext	oldcontext;
-	MemoryContext	aggcontext;
-
 	Numeric			num;
 	Numeric			value;
 	Numeric		   *elements;
@@ -331,22 +1144,26 @@ quantile_append_numeric(PG_FUNCTION_ARGS)
 
 	num = PG_GETARG_NUMERIC(1);
 
-	GET_AGG_CONTEXT("quantile_append_numeric", fcinfo, aggcontext);
-
-	oldcontext = MemoryContextSwitchTo(aggcontext);
-
 	if (PG_ARGISNULL(0))
 	{
-		state = (quantile_state *) palloc(sizeof(quantile_state));
-		state->elements  = palloc(QUANTILE_MIN_ELEMENTS * sizeof(Numeric));
-		state->maxelements = QUANTILE_MIN_ELEMENTS;
-		state->nelements = 0;
+		MemoryContext	oldcontext;
+		MemoryContext	aggcontext;
+
+		/* only look up the aggregate context when creating the state */
+		GET_AGG_CONTEXT("quantile_append_numeric", fcinfo, aggcontext);
+
+		oldcontext = MemoryContextSwitchTo(aggcontext);
+
+		state = state_alloc(QUANTILE_TYPE_NUMERIC, aggcontext,
+							QUANTILE_MIN_ELEMENTS, false);
 
 		state->quantiles = (double *) palloc(sizeof(double));
 		state->quantiles[0] = PG_GETARG_FLOAT8(2);
 		state->nquantiles = 1;
 
 		check_quantiles(state->nquantiles, state->quantiles);
+
+		MemoryContextSwitchTo(oldcontext);
 	}
 	else
 		state = (quantile_state *) PG_GETARG_POINTER(0);
@@ -355,22 +1172,16 @@ quantile_append_numeric(PG_FUNCTION_ARGS)
 
 	/* we can be sure the value is not null (see the check above) */
 	if (state->nelements == state->maxelements)
-	{
-		state->maxelements *= 2;
-		state->elements = repalloc(state->elements,
-								   sizeof(Numeric) * state->maxelements);
-	}
+		state_sort_block(state, QUANTILE_TYPE_NUMERIC);
 
 	/* the value has to be copied into the right memory context */
-	value = (Numeric) palloc(VARSIZE(num));
+	value = (Numeric) MemoryContextAlloc(state->aggcontext, VARSIZE(num));
 	memcpy(value, num, VARSIZE(num));
 
 	/* make sure to cast the array to (Numeric *) before updating it */
 	elements = (Numeric *) state->elements;
 	elements[state->nelements++] = value;
 
-	MemoryContextSwitchTo(oldcontext);
-
 	PG_RETURN_POINTER(state);
 }
 
@@ -378,13 +1189,8 @@ Datum
 quantile_append_numeric_array(PG_FUNCTION_ARGS)
 {
 	quantile_state *state;
-
-	MemoryContext	oldcontext;
-	MemoryContext	aggcontext;
-
 	Numeric			num;
 	Numeric			value;
-	ArrayType	   *quantiles;
 	Numeric		   *elements;
 
 	/* OK, we do want to skip NULL values altogether */
@@ -398,46 +1204,45 @@ quantile_append_numeric_array(PG_FUNCTION_ARGS)
 	}
 
 	num = PG_GETARG_NUMERIC(1);
-	quantiles = PG_GETARG_ARRAYTYPE_P(2);
-
-	GET_AGG_CONTEXT("quantile_append_numeric_array", fcinfo, aggcontext);
-
-	oldcontext = MemoryContextSwitchTo(aggcontext);
 
 	if (PG_ARGISNULL(0))
 	{
-		state = (quantile_state *) palloc(sizeof(quantile_state));
-		state->elements  = palloc(QUANTILE_MIN_ELEMENTS * sizeof(Numeric));
-		state->maxelements = QUANTILE_MIN_ELEMENTS;
-		state->nelements = 0;
+		MemoryContext	oldcontext;
+		MemoryContext	aggcontext;
+
+		/* only look up the aggregate context when creating the state */
+		GET_AGG_CONTEXT("quantile_append_numeric_array", fcinfo, aggcontext);
+
+		oldcontext = MemoryContextSwitchTo(aggcontext);
+
+		state = state_alloc(QUANTILE_TYPE_NUMERIC, aggcontext,
+							QUANTILE_MIN_ELEMENTS, false);
 
 		/* read the array of quantiles */
-		state->quantiles = array_to_double(fcinfo, quantiles,
+		state->quantiles = array_to_double(fcinfo, PG_GETARG_ARRAYTYPE_P(2),
 										   &state->nquantiles);
 
 		check_quantiles(state->nquantiles, state->quantiles);
+
+		MemoryContextSwitchTo(oldcontext);
 	}
 	else
 		state = (quantile_state *) PG_GETARG_POINTER(0);
 
+	AssertCheckQuantileState(state);
+
 	/* we can be sure the value is not null (see the check above) */
 	if (state->nelements == state->maxelements)
-	{
-		state->maxelements *= 2;
-		state->elements = repalloc(state->elements,
-								   sizeof(Numeric) * state->maxelements);
-	}
+		state_sort_block(state, QUANTILE_TYPE_NUMERIC);
 
 	/* the value has to be copied into the right memory context */
-	value = (Numeric) palloc(VARSIZE(num));
+	value = (Numeric) MemoryContextAlloc(state->aggcontext, VARSIZE(num));
 	memcpy(value, num, VARSIZE(num));
 
 	/* make sure to cast the array to (Numeric *) before updating it */
 	elements = (Numeric *) state->elements;
 	elements[state->nelements++] = value;
 
-	MemoryContextSwitchTo(oldcontext);
-
 	PG_RETURN_POINTER(state);
 }
 
@@ -445,10 +1250,6 @@ Datum
 quantile_append_int32(PG_FUNCTION_ARGS)
 {
 	quantile_state *state;
-
-	MemoryContext	oldcontext;
-	MemoryContext	aggcontext;
-
 	int32		   *elements;
 
 	/* OK, we do want to skip NULL values altogether */
@@ -461,23 +1262,26 @@ quantile_append_int32(PG_FUNCTION_ARGS)
 			PG_RETURN_DATUM(PG_GETARG_DATUM(0));
 	}
 
-	GET_AGG_CONTEXT("quantile_append_int32", fcinfo, aggcontext);
-
-	oldcontext = MemoryContextSwitchTo(aggcontext);
-
 	if (PG_ARGISNULL(0))
 	{
-		state = (quantile_state *) palloc(sizeof(quantile_state));
+		MemoryContext	oldcontext;
+		MemoryContext	aggcontext;
+
+		/* only look up the aggregate context when creating the state */
+		GET_AGG_CONTEXT("quantile_append_int32", fcinfo, aggcontext);
+
+		oldcontext = MemoryContextSwitchTo(aggcontext);
 
-		state->elements  = palloc(QUANTILE_MIN_ELEMENTS * sizeof(int32));
-		state->maxelements = QUANTILE_MIN_ELEMENTS;
-		state->nelements = 0;
+		state = state_alloc(QUANTILE_TYPE_INT32, aggcontext,
+							QUANTILE_MIN_ELEMENTS, false);
 
 		state->quantiles = (double *) palloc(sizeof(double));
 		state->quantiles[0] = PG_GETARG_FLOAT8(2);
 		state->nquantiles = 1;
 
 		check_quantiles(state->nquantiles, state->quantiles);
+
+		MemoryContextSwitchTo(oldcontext);
 	}
 	else
 		state = (quantile_state *) PG_GETARG_POINTER(0);
@@ -486,11 +1290,7 @@ quantile_append_int32(PG_FUNCTION_ARGS)
 
 	/* we can be sure the value is not null (see the check above) */
 	if (state->nelements == state->maxelements)
-	{
-		state->maxelements *= 2;
-		state->elements = repalloc(state->elements,
-								   sizeof(int32) * state->maxelements);
-	}
+		state_sort_block(state, QUANTILE_TYPE_INT32);
 
 	Assert(state->nelements < state->maxelements);
 
@@ -498,8 +1298,6 @@ quantile_append_int32(PG_FUNCTION_ARGS)
 	elements = (int32 *) state->elements;
 	elements[state->nelements++] = PG_GETARG_INT32(1);
 
-	MemoryContextSwitchTo(oldcontext);
-
 	PG_RETURN_POINTER(state);
 }
 
@@ -507,11 +1305,6 @@ Datum
 quantile_append_int32_array(PG_FUNCTION_ARGS)
 {
 	quantile_state *state;
-
-	MemoryContext	oldcontext;
-	MemoryContext	aggcontext;
-
-	ArrayType	   *quantiles;
 	int32		   *elements;
 
 	/* OK, we do want to skip NULL values altogether */
@@ -524,25 +1317,26 @@ quantile_append_int32_array(PG_FUNCTION_ARGS)
 			PG_RETURN_DATUM(PG_GETARG_DATUM(0));
 	}
 
-	quantiles = PG_GETARG_ARRAYTYPE_P(2);
-
-	GET_AGG_CONTEXT("quantile_append_int32_array", fcinfo, aggcontext);
-
-	oldcontext = MemoryContextSwitchTo(aggcontext);
-
 	if (PG_ARGISNULL(0))
 	{
-		state = (quantile_state *) palloc(sizeof(quantile_state));
+		MemoryContext	oldcontext;
+		MemoryContext	aggcontext;
+
+		/* only look up the aggregate context when creating the state */
+		GET_AGG_CONTEXT("quantile_append_int32_array", fcinfo, aggcontext);
 
-		state->elements  = palloc(QUANTILE_MIN_ELEMENTS * sizeof(int32));
-		state->maxelements = QUANTILE_MIN_ELEMENTS;
-		state->nelements = 0;
+		oldcontext = MemoryContextSwitchTo(aggcontext);
+
+		state = state_alloc(QUANTILE_TYPE_INT32, aggcontext,
+							QUANTILE_MIN_ELEMENTS, false);
 
 		/* read the array of quantiles */
-		state->quantiles = array_to_double(fcinfo, quantiles,
+		state->quantiles = array_to_double(fcinfo, PG_GETARG_ARRAYTYPE_P(2),
 										   &state->nquantiles);
 
 		check_quantiles(state->nquantiles, state->quantiles);
+
+		MemoryContextSwitchTo(oldcontext);
 	}
 	else
 		state = (quantile_state *) PG_GETARG_POINTER(0);
@@ -551,11 +1345,7 @@ quantile_append_int32_array(PG_FUNCTION_ARGS)
 
 	/* we can be sure the value is not null (see the check above) */
 	if (state->nelements == state->maxelements)
-	{
-		state->maxelements *= 2;
-		state->elements = repalloc(state->elements,
-								   sizeof(int32) * state->maxelements);
-	}
+		state_sort_block(state, QUANTILE_TYPE_INT32);
 
 	Assert(state->nelements < state->maxelements);
 
@@ -563,8 +1353,6 @@ quantile_append_int32_array(PG_FUNCTION_ARGS)
 	elements = (int32 *) state->elements;
 	elements[state->nelements++] = PG_GETARG_INT32(1);
 
-	MemoryContextSwitchTo(oldcontext);
-
 	PG_RETURN_POINTER(state);
 }
 
@@ -572,10 +1360,6 @@ Datum
 quantile_append_int64(PG_FUNCTION_ARGS)
 {
 	quantile_state *state;
-
-	MemoryContext	oldcontext;
-	MemoryContext	aggcontext;
-
 	int64		   *elements;
 
 	/* OK, we do want to skip NULL values altogether */
@@ -588,23 +1372,27 @@ quantile_append_int64(PG_FUNCTION_ARGS)
 			PG_RETURN_DATUM(PG_GETARG_DATUM(0));
 	}
 
-	GET_AGG_CONTEXT("quantile_append_int64", fcinfo, aggcontext);
-
-	oldcontext = MemoryContextSwitchTo(aggcontext);
-
 	if (PG_ARGISNULL(0))
 	{
-		state = (quantile_state *) palloc(sizeof(quantile_state));
+		MemoryContext	oldcontext;
+		MemoryContext	aggcontext;
+
+		/* only look up the aggregate context when creating the state */
+		GET_AGG_CONTEXT("quantile_append_int64", fcinfo, aggcontext);
 
-		state->elements  = palloc(QUANTILE_MIN_ELEMENTS * sizeof(int64));
-		state->maxelements = QUANTILE_MIN_ELEMENTS;
-		state->nelements = 0;
+		oldcontext = MemoryContextSwitchTo(aggcontext);
+
+		state = state_alloc(QUANTILE_TYPE_INT64, aggcontext,
+							QUANTILE_MIN_ELEMENTS, true);
+		state->partial = partial_aggregate(fcinfo);
 
 		state->quantiles = (double *) palloc(sizeof(double));
 		state->quantiles[0] = PG_GETARG_FLOAT8(2);
 		state->nquantiles = 1;
 
 		check_quantiles(state->nquantiles, state->quantiles);
+
+		MemoryContextSwitchTo(oldcontext);
 	}
 	else
 		state = (quantile_state *) PG_GETARG_POINTER(0);
@@ -613,11 +1401,7 @@ quantile_append_int64(PG_FUNCTION_ARGS)
 
 	/* we can be sure the value is not null (see the check above) */
 	if (state->nelements == state->maxelements)
-	{
-		state->maxelements *= 2;
-		state->elements = repalloc(state->elements,
-								   sizeof(int64) * state->maxelements);
-	}
+		quantile_make_room(state, false);
 
 	Assert(state->nelements < state->maxelements);
 
@@ -625,8 +1409,6 @@ quantile_append_int64(PG_FUNCTION_ARGS)
 	elements = (int64 *) state->elements;
 	elements[state->nelements++] = PG_GETARG_INT64(1);
 
-	MemoryContextSwitchTo(oldcontext);
-
 	PG_RETURN_POINTER(state);
 }
 
@@ -634,11 +1416,6 @@ Datum
 quantile_append_int64_array(PG_FUNCTION_ARGS)
 {
 	quantile_state *state;
-
-	MemoryContext	oldcontext;
-	MemoryContext	aggcontext;
-
-	ArrayType	   *quantiles;
 	int64		   *elements;
 
 	/* OK, we do want to skip NULL values altogether */
@@ -651,24 +1428,27 @@ quantile_append_int64_array(PG_FUNCTION_ARGS)
 			PG_RETURN_DATUM(PG_GETARG_DATUM(0));
 	}
 
-	quantiles = PG_GETARG_ARRAYTYPE_P(2);
+	if (PG_ARGISNULL(0))
+	{
+		MemoryContext	oldcontext;
+		MemoryContext	aggcontext;
 
-	GET_AGG_CONTEXT("quantile_append_int64_array", fcinfo, aggcontext);
+		/* only look up the aggregate context when creating the state */
+		GET_AGG_CONTEXT("quantile_append_int64_array", fcinfo, aggcontext);
 
-	oldcontext = MemoryContextSwitchTo(aggcontext);
+		oldcontext = MemoryContextSwitchTo(aggcontext);
 
-	if (PG_ARGISNULL(0))
-	{
-		state = (quantile_state *) palloc(sizeof(quantile_state));
-		state->elements = palloc(QUANTILE_MIN_ELEMENTS * sizeof(int64));
-		state->maxelements = QUANTILE_MIN_ELEMENTS;
-		state->nelements = 0;
+		state = state_alloc(QUANTILE_TYPE_INT64, aggcontext,
+							QUANTILE_MIN_ELEMENTS, true);
+		state->partial = partial_aggregate(fcinfo);
 
 		/* read the array of quantiles */
-		state->quantiles = array_to_double(fcinfo, quantiles,
+		state->quantiles = array_to_double(fcinfo, PG_GETARG_ARRAYTYPE_P(2),
 										   &state->nquantiles);
 
 		check_quantiles(state->nquantiles, state->quantiles);
+
+		MemoryContextSwitchTo(oldcontext);
 	}
 	else
 		state = (quantile_state *) PG_GETARG_POINTER(0);
@@ -677,11 +1457,7 @@ quantile_append_int64_array(PG_FUNCTION_ARGS)
 
 	/* we can be sure the value is not null (see the check above) */
 	if (state->nelements == state->maxelements)
-	{
-		state->maxelements *= 2;
-		state->elements = repalloc(state->elements,
-								   sizeof(int64) * state->maxelements);
-	}
+		quantile_make_room(state, false);
 
 	Assert(state->nelements < state->maxelements);
 
@@ -689,8 +1465,6 @@ quantile_append_int64_array(PG_FUNCTION_ARGS)
 	elements = (int64 *) state->elements;
 	elements[state->nelements++] = PG_GETARG_INT64(1);
 
-	MemoryContextSwitchTo(oldcontext);
-
 	PG_RETURN_POINTER(state);
 }
 
@@ -700,6 +1474,7 @@ quantile_double(PG_FUNCTION_ARGS)
 	int				idx = 0;
 	quantile_state *state;
 	double		   *elements;
+	double			tail;
 
 	CHECK_AGG_CONTEXT("quantile_double", fcinfo);
 
@@ -709,7 +1484,27 @@ quantile_double(PG_FUNCTION_ARGS)
 	state = (quantile_state *) PG_GETARG_POINTER(0);
 	elements = (double *) state->elements;
 
-	qsort(state->elements, state->nelements, sizeof(double), &double_comparator);
+	if (state->spill)
+		PG_RETURN_FLOAT8(key_to_double(spill_quantile(state,
+													  state->quantiles[0],
+													  true)));
+
+	/* combined partial states (parallel query), select from the sorted runs */
+	if (state->nruns > 0)
+	{
+		double	result;
+
+		state_runs_quantiles(state, QUANTILE_TYPE_DOUBLE, (char *) &result);
+
+		PG_RETURN_FLOAT8(result);
+	}
+
+	/* extreme quantiles only need a small heap, not a sorted array */
+	if (quantile_select(state->elements, state->nelements, QUANTILE_TYPE_DOUBLE,
+					state->quantiles[0], (char *) &tail))
+		PG_RETURN_FLOAT8(tail);
+
+	quantile_sort(state->elements, state->nelements, QUANTILE_TYPE_DOUBLE);
 
 	if (state->quantiles[0] > 0)
 		idx = (int) ceil(state->nelements * state->quantiles[0]) - 1;
@@ -735,7 +1530,31 @@ quantile_double_array(PG_FUNCTION_ARGS)
 	result = palloc(state->nquantiles * sizeof(double));
 	elements = (double *) state->elements;
 
-	qsort(state->elements, state->nelements, sizeof(double), &double_comparator);
+	if (state->spill)
+	{
+		for (i = 0; i < state->nquantiles; i++)
+			result[i] = key_to_double(spill_quantile(state,
+													 state->quantiles[i],
+													 true));
+
+		return double_to_array(fcinfo, result, state->nquantiles);
+	}
+
+	/* combined partial states (parallel query), select from the sorted runs */
+	if (state->nruns > 0)
+	{
+		state_runs_quantiles(state, QUANTILE_TYPE_DOUBLE, (char *) result);
+
+		return double_to_array(fcinfo, result, state->nquantiles);
+	}
+
+	/* a single quantile does not need all the values sorted */
+	if ((state->nquantiles == 1) &&
+		quantile_select(state->elements, state->nelements, QUANTILE_TYPE_DOUBLE,
+						state->quantiles[0], (char *) result))
+		return double_to_array(fcinfo, result, 1);
+
+	quantile_sort(state->elements, state->nelements, QUANTILE_TYPE_DOUBLE);
 
 	for (i = 0; i < state->nquantiles; i++)
 	{
@@ -756,6 +1575,7 @@ quantile_int32(PG_FUNCTION_ARGS)
 	int				idx = 0;
 	quantile_state *state;
 	int32		   *elements;
+	int32			tail;
 
 	CHECK_AGG_CONTEXT("quantile_int32", fcinfo);
 
@@ -765,7 +1585,22 @@ quantile_int32(PG_FUNCTION_ARGS)
 	state = (quantile_state *) PG_GETARG_POINTER(0);
 	elements = (int32 *) state->elements;
 
-	qsort(state->elements, state->nelements, sizeof(int32), &int32_comparator);
+	/* combined partial states (parallel query), select from the sorted runs */
+	if (state->nruns > 0)
+	{
+		int32	result;
+
+		state_runs_quantiles(state, QUANTILE_TYPE_INT32, (char *) &result);
+
+		PG_RETURN_INT32(result);
+	}
+
+	/* extreme quantiles only need a small heap, not a sorted array */
+	if (quantile_select(state->elements, state->nelements, QUANTILE_TYPE_INT32,
+					state->quantiles[0], (char *) &tail))
+		PG_RETURN_INT32(tail);
+
+	quantile_sort(state->elements, state->nelements, QUANTILE_TYPE_INT32);
 
 	if (state->quantiles[0] > 0)
 		idx = (int) ceil(state->nelements * state->quantiles[0]) - 1;
@@ -791,7 +1626,21 @@ quantile_int32_array(PG_FUNCTION_ARGS)
 	result = palloc(state->nquantiles * sizeof(int32));
 	elements = (int32 *) state->elements;
 
-	qsort(state->elements, state->nelements, sizeof(int32), &int32_comparator);
+	/* combined partial states (parallel query), select from the sorted runs */
+	if (state->nruns > 0)
+	{
+		state_runs_quantiles(state, QUANTILE_TYPE_INT32, (char *) result);
+
+		return int32_to_array(fcinfo, result, state->nquantiles);
+	}
+
+	/* a single quantile does not need all the values sorted */
+	if ((state->nquantiles == 1) &&
+		quantile_select(state->elements, state->nelements, QUANTILE_TYPE_INT32,
+						state->quantiles[0], (char *) result))
+		return int32_to_array(fcinfo, result, 1);
+
+	quantile_sort(state->elements, state->nelements, QUANTILE_TYPE_INT32);
 
 	for (i = 0; i < state->nquantiles; i++)
 	{
@@ -811,6 +1660,7 @@ quantile_int64(PG_FUNCTION_ARGS)
 	int				idx = 0;
 	quantile_state *state;
 	int64		   *elements;
+	int64			tail;
 
 	CHECK_AGG_CONTEXT("quantile_int64", fcinfo);
 
@@ -821,7 +1671,27 @@ quantile_int64(PG_FUNCTION_ARGS)
 
 	elements = (int64 *) state->elements;
 
-	qsort(state->elements, state->nelements, sizeof(int64), &int64_comparator);
+	if (state->spill)
+		PG_RETURN_INT64(key_to_int64(spill_quantile(state,
+													state->quantiles[0],
+													false)));
+
+	/* combined partial states (parallel query), select from the sorted runs */
+	if (state->nruns > 0)
+	{
+		int64	result;
+
+		state_runs_quantiles(state, QUANTILE_TYPE_INT64, (char *) &result);
+
+		PG_RETURN_INT64(result);
+	}
+
+	/* extreme quantiles only need a small heap, not a sorted array */
+	if (quantile_select(state->elements, state->nelements, QUANTILE_TYPE_INT64,
+					state->quantiles[0], (char *) &tail))
+		PG_RETURN_INT64(tail);
+
+	quantile_sort(state->elements, state->nelements, QUANTILE_TYPE_INT64);
 
 	if (state->quantiles[0] > 0)
 		idx = (int) ceil(state->nelements * state->quantiles[0]) - 1;
@@ -848,7 +1718,31 @@ quantile_int64_array(PG_FUNCTION_ARGS)
 
 	result = palloc(state->nquantiles * sizeof(int64));
 
-	qsort(state->elements, state->nelements, sizeof(int64), &int64_comparator);
+	if (state->spill)
+	{
+		for (i = 0; i < state->nquantiles; i++)
+			result[i] = key_to_int64(spill_quantile(state,
+													state->quantiles[i],
+													false));
+
+		return int64_to_array(fcinfo, result, state->nquantiles);
+	}
+
+	/* combined partial states (parallel query), select from the sorted runs */
+	if (state->nruns > 0)
+	{
+		state_runs_quantiles(state, QUANTILE_TYPE_INT64, (char *) result);
+
+		return int64_to_array(fcinfo, result, state->nquantiles);
+	}
+
+	/* a single quantile does not need all the values sorted */
+	if ((state->nquantiles == 1) &&
+		quantile_select(state->elements, state->nelements, QUANTILE_TYPE_INT64,
+						state->quantiles[0], (char *) result))
+		return int64_to_array(fcinfo, result, 1);
+
+	quantile_sort(state->elements, state->nelements, QUANTILE_TYPE_INT64);
 
 	for (i = 0; i < state->nquantiles; i++)
 	{
@@ -868,6 +1762,7 @@ quantile_numeric(PG_FUNCTION_ARGS)
 	int				idx = 0;
 	quantile_state *state;
 	Numeric		   *elements;
+	Numeric			tail;
 
 	CHECK_AGG_CONTEXT("quantile_numeric", fcinfo);
 
@@ -878,7 +1773,22 @@ quantile_numeric(PG_FUNCTION_ARGS)
 
 	elements = (Numeric *) state->elements;
 
-	qsort(state->elements, state->nelements, sizeof(Numeric), &numeric_comparator);
+	/* combined partial states (parallel query), select from the sorted runs */
+	if (state->nruns > 0)
+	{
+		Numeric	result;
+
+		state_runs_quantiles(state, QUANTILE_TYPE_NUMERIC, (char *) &result);
+
+		PG_RETURN_NUMERIC(result);
+	}
+
+	/* extreme quantiles only need a small heap, not a sorted array */
+	if (quantile_select(state->elements, state->nelements, QUANTILE_TYPE_NUMERIC,
+					state->quantiles[0], (char *) &tail))
+		PG_RETURN_NUMERIC(tail);
+
+	quantile_sort(state->elements, state->nelements, QUANTILE_TYPE_NUMERIC);
 
 	if (state->quantiles[0] > 0)
 		idx = (int) ceil(state->nelements * state->quantiles[0]) - 1;
@@ -907,7 +1817,21 @@ quantile_numeric_array(PG_FUNCTION_ARGS)
 
 	elements = (Numeric *) state->elements;
 
-	qsort(elements, state->nelements, sizeof(Numeric), &numeric_comparator);
+	/* combined partial states (parallel query), select from the sorted runs */
+	if (state->nruns > 0)
+	{
+		state_runs_quantiles(state, QUANTILE_TYPE_NUMERIC, (char *) result);
+
+		return numeric_to_array(fcinfo, result, state->nquantiles);
+	}
+
+	/* a single quantile does not need all the values sorted */
+	if ((state->nquantiles == 1) &&
+		quantile_select(state->elements, state->nelements, QUANTILE_TYPE_NUMERIC,
+						state->quantiles[0], (char *) result))
+		return numeric_to_array(fcinfo, result, 1);
+
+	quantile_sort(elements, state->nelements, QUANTILE_TYPE_NUMERIC);
 
 	for (i = 0; i < state->nquantiles; i++)
 	{
@@ -922,209 +1846,5594 @@ quantile_numeric_array(PG_FUNCTION_ARGS)
 	return numeric_to_array(fcinfo, result, state->nquantiles);
 }
 
-/* Comparators for the qsort() calls. */
-
-static int
-double_comparator(const void *a, const void *b)
+/*
+ * Approximate quantiles with a deterministic error guarantee - the rank
+ * of the returned value differs from the requested rank by at most
+ * (epsilon * count), no matter what the input is.
+ */
+static Datum
+eps_append(FunctionCallInfo fcinfo, int type, const char *fname)
 {
-	double af = (* (double*) a);
-	double bf = (* (double*) b);
-	return (af > bf) - (af < bf);
+	quantile_eps_state *state;
+
+	/* OK, we do want to skip NULL values altogether */
+	if (PG_ARGISNULL(1))
+	{
+		if (PG_ARGISNULL(0))
+			PG_RETURN_NULL();
+		else
+			/* if there already is a state accumulated, don't forget it */
+			PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	}
+
+	if (PG_ARGISNULL(0))
+	{
+		MemoryContext	oldcontext;
+		MemoryContext	aggcontext;
+
+		/* only look up the aggregate context when creating the state */
+		GET_AGG_CONTEXT(fname, fcinfo, aggcontext);
+
+		oldcontext = MemoryContextSwitchTo(aggcontext);
+
+		state = eps_state_create(fcinfo, type);
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+	else
+		state = (quantile_eps_state *) PG_GETARG_POINTER(0);
+
+	/*
+	 * The summary arrays are enlarged in place (repalloc) when flushing the
+	 * buffer, so only the numeric values need to be copied explicitly.
+	 */
+
+	switch (type)
+	{
+		case QUANTILE_TYPE_INT32:
+		{
+			int32	value = PG_GETARG_INT32(1);
+			eps_state_add(state, &value);
+			break;
+		}
+
+		case QUANTILE_TYPE_INT64:
+		{
+			int64	value = PG_GETARG_INT64(1);
+			eps_state_add(state, &value);
+			break;
+		}
+
+		case QUANTILE_TYPE_DOUBLE:
+		{
+			double	value = PG_GETARG_FLOAT8(1);
+			eps_state_add(state, &value);
+			break;
+		}
+
+		case QUANTILE_TYPE_NUMERIC:
+		{
+			Numeric	num = PG_GETARG_NUMERIC(1);
+
+			/* the value has to be copied into the right memory context */
+			Numeric	value = (Numeric) MemoryContextAlloc(state->context,
+														 VARSIZE(num));
+			memcpy(value, num, VARSIZE(num));
+
+			eps_state_add(state, &value);
+			break;
+		}
+	}
+
+	PG_RETURN_POINTER(state);
 }
 
-static int
-int32_comparator(const void *a, const void *b)
+Datum
+quantile_eps_append_double(PG_FUNCTION_ARGS)
 {
-	int32 af = (* (int32 *) a);
-	int32 bf = (* (int32 *) b);
-	return (af > bf) - (af < bf);
+	return eps_append(fcinfo, QUANTILE_TYPE_DOUBLE,
+					  "quantile_eps_append_double");
 }
 
-static int
-int64_comparator(const void *a, const void *b)
+Datum
+quantile_eps_append_int32(PG_FUNCTION_ARGS)
 {
-	int64 af = (* (int64 *) a);
-	int64 bf = (* (int64 *) b);
-	return (af > bf) - (af < bf);
+	return eps_append(fcinfo, QUANTILE_TYPE_INT32,
+					  "quantile_eps_append_int32");
 }
 
-static int
-numeric_comparator(const void *a, const void *b)
+Datum
+quantile_eps_append_int64(PG_FUNCTION_ARGS)
 {
-	Numeric	na = (* (Numeric *) a);
-	Numeric	nb = (* (Numeric *) b);
+	return eps_append(fcinfo, QUANTILE_TYPE_INT64,
+					  "quantile_eps_append_int64");
+}
 
-	return DatumGetInt32(DirectFunctionCall2(numeric_cmp,
-											 NumericGetDatum(na),
-											 NumericGetDatum(nb)));
+Datum
+quantile_eps_append_numeric(PG_FUNCTION_ARGS)
+{
+	return eps_append(fcinfo, QUANTILE_TYPE_NUMERIC,
+					  "quantile_eps_append_numeric");
 }
 
-/*
- * Reading quantiles from an input array, based mostly on
- * array_to_text_internal (it's a modified copy). This expects
- * to receive a single-dimensional float8 array as input, fails
- * otherwise.
- */
-static double *
-array_to_double(FunctionCallInfo fcinfo, ArrayType *array, int *arraylen)
+Datum
+quantile_eps_double(PG_FUNCTION_ARGS)
 {
-	int			i;
-	Datum	   *keys;
-	int			nkeys;
+	quantile_eps_state *state;
+	double	   *result;
 
-	/* info for deconstructing the array */
-	Oid			element_type;
-	int			typlen;
-	bool		typbyval;
-	char		typalign;
+	CHECK_AGG_CONTEXT("quantile_eps_double", fcinfo);
 
-	ArrayMetaState *my_extra;
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
 
-	/* result */
-	double	   *result;
+	state = (quantile_eps_state *) PG_GETARG_POINTER(0);
 
-	element_type = ARR_ELEMTYPE(array);
+	result = palloc(state->nquantiles * sizeof(double));
 
-	if (element_type != FLOAT8OID)
-		elog(ERROR, "array expected to be double precision[]");
+	eps_state_query(state, result);
 
-	/*
-	 * We arrange to look up info about element type, including its output
-	 * conversion proc, only once per series of calls, assuming the element
-	 * type doesn't change underneath us.
-	 */
-	my_extra = (ArrayMetaState *) fcinfo->flinfo->fn_extra;
-	if (my_extra == NULL)
-	{
-		fcinfo->flinfo->fn_extra = MemoryContextAlloc(fcinfo->flinfo->fn_mcxt,
-													  sizeof(ArrayMetaState));
-		my_extra = (ArrayMetaState *) fcinfo->flinfo->fn_extra;
-		my_extra->element_type = ~element_type;
-	}
+	return double_to_array(fcinfo, result, state->nquantiles);
+}
 
-	/*
-	 * Get info about element type, including its output conversion proc, if
-	 * we haven't done that already.
-	 */
-	if (my_extra->element_type != element_type)
-	{
-		get_type_io_data(element_type, IOFunc_output,
-						 &my_extra->typlen, &my_extra->typbyval,
-						 &my_extra->typalign, &my_extra->typdelim,
-						 &my_extra->typioparam, &my_extra->typiofunc);
-		fmgr_info_cxt(my_extra->typiofunc, &my_extra->proc,
-					  fcinfo->flinfo->fn_mcxt);
-		my_extra->element_type = element_type;
-	}
+Datum
+quantile_eps_int32(PG_FUNCTION_ARGS)
+{
+	quantile_eps_state *state;
+	int32	   *result;
 
-	typlen = my_extra->typlen;
-	typbyval = my_extra->typbyval;
-	typalign = my_extra->typalign;
+	CHECK_AGG_CONTEXT("quantile_eps_int32", fcinfo);
 
-	/* Extract data from array of int16 */
-	deconstruct_array(array, FLOAT8OID, typlen, typbyval, typalign,
-					  &keys, NULL, &nkeys);
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
 
-	result = (double *) palloc(sizeof(double) * nkeys);
+	state = (quantile_eps_state *) PG_GETARG_POINTER(0);
 
-	for (i = 0; i < nkeys; i++)
-		result[i] = DatumGetFloat8(keys[i]);
+	result = palloc(state->nquantiles * sizeof(int32));
 
-	*arraylen = nkeys;
+	eps_state_query(state, result);
 
-	return result;
+	return int32_to_array(fcinfo, result, state->nquantiles);
+}
+
+Datum
+quantile_eps_int64(PG_FUNCTION_ARGS)
+{
+	quantile_eps_state *state;
+	int64	   *result;
+
+	CHECK_AGG_CONTEXT("quantile_eps_int64", fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	state = (quantile_eps_state *) PG_GETARG_POINTER(0);
+
+	result = palloc(state->nquantiles * sizeof(int64));
+
+	eps_state_query(state, result);
+
+	return int64_to_array(fcinfo, result, state->nquantiles);
+}
+
+Datum
+quantile_eps_numeric(PG_FUNCTION_ARGS)
+{
+	quantile_eps_state *state;
+	Numeric	   *result;
+
+	CHECK_AGG_CONTEXT("quantile_eps_numeric", fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	state = (quantile_eps_state *) PG_GETARG_POINTER(0);
+
+	result = palloc(state->nquantiles * sizeof(Numeric));
+
+	eps_state_query(state, result);
+
+	return numeric_to_array(fcinfo, result, state->nquantiles);
 }
 
 /*
- * Helper functions used to prepare the resulting array (when there's
- * an array of quantiles).
+ * Combine two summaries (parallel aggregation). Merging the summaries
+ * does not increase the relative rank error.
  */
-static Datum
-double_to_array(FunctionCallInfo fcinfo, double * d, int len)
+Datum
+quantile_eps_combine(PG_FUNCTION_ARGS)
 {
-	ArrayBuildState *astate = NULL;
-	int		 i;
+	quantile_eps_state *src;
+	quantile_eps_state *dst;
+	quantile_eps_state *result;
+	MemoryContext	aggcontext;
+	MemoryContext	oldcontext;
 
-	for (i = 0; i < len; i++)
+	GET_AGG_CONTEXT("quantile_eps_combine", fcinfo, aggcontext);
+
+	if (PG_ARGISNULL(1))
 	{
-		/* stash away this field */
-		astate = accumArrayResult(astate,
-								  Float8GetDatum(d[i]),
-								  false,
-								  FLOAT8OID,
-								  CurrentMemoryContext);
+		if (PG_ARGISNULL(0))
+			PG_RETURN_NULL();
+
+		PG_RETURN_DATUM(PG_GETARG_DATUM(0));
 	}
 
-	PG_RETURN_DATUM(makeArrayResult(astate,
-									CurrentMemoryContext));
+	src = (quantile_eps_state *) PG_GETARG_POINTER(1);
+	dst = PG_ARGISNULL(0) ? NULL : (quantile_eps_state *) PG_GETARG_POINTER(0);
+
+	oldcontext = MemoryContextSwitchTo(aggcontext);
+
+	/* merging with an empty summary makes a copy in the right context */
+	result = eps_state_merge(dst, src);
+
+	/* the merged summary is a new copy, so the old one is not needed */
+	if (dst != NULL)
+		eps_state_free(dst);
+
+	MemoryContextSwitchTo(oldcontext);
+
+	PG_RETURN_POINTER(result);
 }
 
-static Datum
-int32_to_array(FunctionCallInfo fcinfo, int32 * d, int len)
+/*
+ * Serialize the summary into a bytea value (for parallel aggregation).
+ * The buffer gets added to the summary first, so it's not serialized.
+ */
+Datum
+quantile_eps_serialize(PG_FUNCTION_ARGS)
 {
-	ArrayBuildState *astate = NULL;
-	int		 i;
+	int			i;
+	quantile_eps_state *state;
+	StringInfoData buf;
 
-	for (i = 0; i < len; i++)
+	CHECK_AGG_CONTEXT("quantile_eps_serialize", fcinfo);
+
+	state = (quantile_eps_state *) PG_GETARG_POINTER(0);
+
+	eps_state_flush(state);
+
+	pq_begintypsend(&buf);
+
+	pq_sendint32(&buf, state->type);
+	pq_sendfloat8(&buf, state->epsilon);
+
+	pq_sendint32(&buf, state->nquantiles);
+	for (i = 0; i < state->nquantiles; i++)
+		pq_sendfloat8(&buf, state->quantiles[i]);
+
+	pq_sendint64(&buf, state->count);
+	pq_sendint32(&buf, state->ntuples);
+
+	for (i = 0; i < state->ntuples; i++)
 	{
-		/* stash away this field */
-		astate = accumArrayResult(astate,
-								  Int32GetDatum(d[i]),
-								  false,
-								  INT4OID,
-								  CurrentMemoryContext);
+		send_element(&buf, state->type,
+					 (char *) state->values + i * quantile_type_size(state->type));
+
+		pq_sendint64(&buf, state->tuples[i].g);
+		pq_sendint64(&buf, state->tuples[i].delta);
 	}
 
-	PG_RETURN_DATUM(makeArrayResult(astate,
-									CurrentMemoryContext));
+	PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+Datum
+quantile_eps_deserialize(PG_FUNCTION_ARGS)
+{
+	int			i;
+	bytea	   *sstate;
+	quantile_eps_state *state;
+	StringInfoData buf;
+
+	CHECK_AGG_CONTEXT("quantile_eps_deserialize", fcinfo);
+
+	sstate = PG_GETARG_BYTEA_PP(0);
+
+	initStringInfo(&buf);
+	appendBinaryStringInfo(&buf, VARDATA_ANY(sstate),
+						   VARSIZE_ANY_EXHDR(sstate));
+
+	state = (quantile_eps_state *) palloc0(sizeof(quantile_eps_state));
+
+	state->type = pq_getmsgint(&buf, 4);
+	state->epsilon = pq_getmsgfloat8(&buf);
+	state->context = CurrentMemoryContext;
+
+	state->nquantiles = pq_getmsgint(&buf, 4);
+	state->quantiles = (double *) palloc(sizeof(double) * state->nquantiles);
+	for (i = 0; i < state->nquantiles; i++)
+		state->quantiles[i] = pq_getmsgfloat8(&buf);
+
+	state->count = pq_getmsgint64(&buf);
+	state->ntuples = pq_getmsgint(&buf, 4);
+	state->maxtuples = Max(state->ntuples, 1);
+
+	state->values = palloc(quantile_type_size(state->type) * state->maxtuples);
+	state->tuples = (gk_tuple *) palloc(sizeof(gk_tuple) * state->maxtuples);
+
+	for (i = 0; i < state->ntuples; i++)
+	{
+		recv_element(&buf, state->type,
+					 (char *) state->values + i * quantile_type_size(state->type));
+
+		state->tuples[i].g = pq_getmsgint64(&buf);
+		state->tuples[i].delta = pq_getmsgint64(&buf);
+	}
+
+	pq_getmsgend(&buf);
+	pfree(buf.data);
+
+	/* the buffer is empty, but allocate it so that we can add values */
+	state->maxbuffered = QUANTILE_EPS_MIN_BUFFER;
+	state->buffer = palloc(quantile_type_size(state->type) * state->maxbuffered);
+
+	PG_RETURN_POINTER(state);
 }
 
+/*
+ * Rank (CDF) aggregates - for each threshold, return the fraction of
+ * values less than or equal to it. The values are collected into the
+ * same quantile_state as for the quantile aggregates, and the final
+ * function sorts them once and then does a binary search for each
+ * threshold. The combined variant also computes the quantiles from
+ * the same sorted array.
+ */
 static Datum
-int64_to_array(FunctionCallInfo fcinfo, int64 * d, int len)
+rank_append(FunctionCallInfo fcinfo, int type, bool quantiles,
+			const char *fname)
 {
+	quantile_state *state;
 
-	ArrayBuildState *astate = NULL;
-	int		 i;
+	/* OK, we do want to skip NULL values altogether */
+	if (PG_ARGISNULL(1))
+	{
+		if (PG_ARGISNULL(0))
+			PG_RETURN_NULL();
+		else
+			/* if there already is a state accumulated, don't forget it */
+			PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	}
 
-	for (i = 0; i < len; i++)
+	if (PG_ARGISNULL(0))
 	{
-		/* stash away this field */
-		astate = accumArrayResult(astate,
-								  Int64GetDatum(d[i]),
-								  false,
-								  INT8OID,
-								  CurrentMemoryContext);
+		int				argno = (quantiles) ? 3 : 2;
+		MemoryContext	oldcontext;
+		MemoryContext	aggcontext;
+
+		/* only look up the aggregate context when creating the state */
+		GET_AGG_CONTEXT(fname, fcinfo, aggcontext);
+
+		oldcontext = MemoryContextSwitchTo(aggcontext);
+
+		if (PG_ARGISNULL(argno) || (quantiles && PG_ARGISNULL(2)))
+			elog(ERROR, "quantiles and thresholds must not be NULL");
+
+		state = state_alloc(type, aggcontext, QUANTILE_MIN_ELEMENTS, false);
+
+		/* read the array of quantiles */
+		if (quantiles)
+		{
+			state->quantiles = array_to_double(fcinfo, PG_GETARG_ARRAYTYPE_P(2),
+											   &state->nquantiles);
+
+			check_quantiles(state->nquantiles, state->quantiles);
+		}
+
+		/* read the array of thresholds */
+		state->thresholds = array_to_elements(PG_GETARG_ARRAYTYPE_P(argno),
+											  type, &state->nthresholds);
+
+		MemoryContextSwitchTo(oldcontext);
 	}
+	else
+		state = (quantile_state *) PG_GETARG_POINTER(0);
 
-	PG_RETURN_DATUM(makeArrayResult(astate,
-									CurrentMemoryContext));
+	AssertCheckQuantileState(state);
+
+	state_append_datum(state, type, PG_GETARG_DATUM(1));
+
+	PG_RETURN_POINTER(state);
+}
+
+Datum
+quantile_rank_append_double(PG_FUNCTION_ARGS)
+{
+	return rank_append(fcinfo, QUANTILE_TYPE_DOUBLE, false,
+					   "quantile_rank_append_double");
+}
+
+Datum
+quantile_rank_append_int32(PG_FUNCTION_ARGS)
+{
+	return rank_append(fcinfo, QUANTILE_TYPE_INT32, false,
+					   "quantile_rank_append_int32");
+}
+
+Datum
+quantile_rank_append_int64(PG_FUNCTION_ARGS)
+{
+	return rank_append(fcinfo, QUANTILE_TYPE_INT64, false,
+					   "quantile_rank_append_int64");
+}
+
+Datum
+quantile_rank_append_numeric(PG_FUNCTION_ARGS)
+{
+	return rank_append(fcinfo, QUANTILE_TYPE_NUMERIC, false,
+					   "quantile_rank_append_numeric");
+}
+
+Datum
+quantile_and_rank_append_double(PG_FUNCTION_ARGS)
+{
+	return rank_append(fcinfo, QUANTILE_TYPE_DOUBLE, true,
+					   "quantile_and_rank_append_double");
+}
+
+Datum
+quantile_and_rank_append_int32(PG_FUNCTION_ARGS)
+{
+	return rank_append(fcinfo, QUANTILE_TYPE_INT32, true,
+					   "quantile_and_rank_append_int32");
+}
+
+Datum
+quantile_and_rank_append_int64(PG_FUNCTION_ARGS)
+{
+	return rank_append(fcinfo, QUANTILE_TYPE_INT64, true,
+					   "quantile_and_rank_append_int64");
+}
+
+Datum
+quantile_and_rank_append_numeric(PG_FUNCTION_ARGS)
+{
+	return rank_append(fcinfo, QUANTILE_TYPE_NUMERIC, true,
+					   "quantile_and_rank_append_numeric");
+}
+
+/*
+ * Sort the elements and compute the fractions of values less than or
+ * equal to each threshold (upper bound, using a binary search).
+ */
+static double *
+state_ranks(quantile_state *state, int type)
+{
+	int		i;
+	double *ranks;
+	Size	elsize = quantile_type_size(type);
+	int		(*cmp) (const void *a, const void *b);
+
+	cmp = quantile_type_comparator(type);
+
+	quantile_sort(state->elements, state->nelements, type);
+
+	ranks = (double *) palloc(sizeof(double) * Max(state->nthresholds, 1));
+
+	for (i = 0; i < state->nthresholds; i++)
+	{
+		int		lo = 0,
+				hi = state->nelements;
+		char   *threshold = (char *) state->thresholds + i * elsize;
+
+		/* find the first element greater than the threshold */
+		while (lo < hi)
+		{
+			int		mid = lo + (hi - lo) / 2;
+
+			if (cmp((char *) state->elements + mid * elsize, threshold) <= 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		ranks[i] = (double) lo / state->nelements;
+	}
+
+	return ranks;
 }
 
 static Datum
-numeric_to_array(FunctionCallInfo fcinfo, Numeric * d, int len)
+rank_final(FunctionCallInfo fcinfo, int type, bool quantiles)
 {
-	ArrayBuildState *astate = NULL;
-	int		 i;
+	int				i;
+	quantile_state *state;
+	double		   *ranks;
+	Size			elsize = quantile_type_size(type);
+	char		   *result;
+	TupleDesc		tupdesc;
+	Datum			values[2];
+	bool			nulls[2] = {false, false};
 
-	for (i = 0; i < len; i++)
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	state = (quantile_state *) PG_GETARG_POINTER(0);
+
+	/* this sorts the elements, so we can just pick the quantiles */
+	ranks = state_ranks(state, type);
+
+	if (!quantiles)
+		return double_to_array(fcinfo, ranks, state->nthresholds);
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	result = palloc(elsize * Max(state->nquantiles, 1));
+
+	for (i = 0; i < state->nquantiles; i++)
 	{
-		/* stash away this field */
-		astate = accumArrayResult(astate,
-								  NumericGetDatum(d[i]),
-								  false,
-								  NUMERICOID,
-								  CurrentMemoryContext);
+		int	idx = 0;
+
+		if (state->quantiles[i] > 0)
+			idx = (int) ceil(state->nelements * state->quantiles[i]) - 1;
+
+		memcpy(result + i * elsize, (char *) state->elements + idx * elsize, elsize);
 	}
 
-	PG_RETURN_DATUM(makeArrayResult(astate,
-									CurrentMemoryContext));
+	values[0] = elements_to_array(fcinfo, type, result, state->nquantiles);
+	values[1] = double_to_array(fcinfo, ranks, state->nthresholds);
+
+	tupdesc = BlessTupleDesc(tupdesc);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
 }
 
-static void
-check_quantiles(int nquantiles, double * quantiles)
+Datum
+quantile_rank_double(PG_FUNCTION_ARGS)
 {
-	int i = 0;
-	for (i = 0; i < nquantiles; i++)
-		if (quantiles[i] < 0 || quantiles[i] > 1)
-			elog(ERROR, "invalid percentile value %f - needs to be in [0,1]", quantiles[i]);
+	CHECK_AGG_CONTEXT("quantile_rank_double", fcinfo);
+
+	return rank_final(fcinfo, QUANTILE_TYPE_DOUBLE, false);
+}
+
+Datum
+quantile_rank_int32(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("quantile_rank_int32", fcinfo);
+
+	return rank_final(fcinfo, QUANTILE_TYPE_INT32, false);
+}
+
+Datum
+quantile_rank_int64(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("quantile_rank_int64", fcinfo);
+
+	return rank_final(fcinfo, QUANTILE_TYPE_INT64, false);
+}
+
+Datum
+quantile_rank_numeric(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("quantile_rank_numeric", fcinfo);
+
+	return rank_final(fcinfo, QUANTILE_TYPE_NUMERIC, false);
+}
+
+Datum
+quantile_and_rank_double(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("quantile_and_rank_double", fcinfo);
+
+	return rank_final(fcinfo, QUANTILE_TYPE_DOUBLE, true);
+}
+
+Datum
+quantile_and_rank_int32(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("quantile_and_rank_int32", fcinfo);
+
+	return rank_final(fcinfo, QUANTILE_TYPE_INT32, true);
+}
+
+Datum
+quantile_and_rank_int64(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("quantile_and_rank_int64", fcinfo);
+
+	return rank_final(fcinfo, QUANTILE_TYPE_INT64, true);
+}
+
+Datum
+quantile_and_rank_numeric(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("quantile_and_rank_numeric", fcinfo);
+
+	return rank_final(fcinfo, QUANTILE_TYPE_NUMERIC, true);
+}
+
+/*
+ * Equi-depth histogram - boundaries of nbuckets buckets with (roughly)
+ * the same number of values, and the exact number of values in each
+ * bucket. The boundaries are picked the same way as for quantile(), i.e.
+ * the i-th boundary is the (i / nbuckets) quantile, and the first one is
+ * the minimum. Bucket i contains values in (boundary[i-1], boundary[i]],
+ * except the first one which includes the minimum, so with duplicate
+ * values some buckets may be empty (and boundaries repeated).
+ */
+static Datum
+buckets_append(FunctionCallInfo fcinfo, int type, const char *fname)
+{
+	quantile_state *state;
+
+	/* OK, we do want to skip NULL values altogether */
+	if (PG_ARGISNULL(1))
+	{
+		if (PG_ARGISNULL(0))
+			PG_RETURN_NULL();
+		else
+			/* if there already is a state accumulated, don't forget it */
+			PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	}
+
+	if (PG_ARGISNULL(0))
+	{
+		MemoryContext	oldcontext;
+		MemoryContext	aggcontext;
+
+		/* only look up the aggregate context when creating the state */
+		GET_AGG_CONTEXT(fname, fcinfo, aggcontext);
+
+		oldcontext = MemoryContextSwitchTo(aggcontext);
+
+		if (PG_ARGISNULL(2) || (PG_GETARG_INT32(2) < 1))
+			elog(ERROR, "invalid number of buckets - needs to be a positive integer");
+
+		state = state_alloc(type, aggcontext, QUANTILE_MIN_ELEMENTS, false);
+
+		state->nbuckets = PG_GETARG_INT32(2);
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+	else
+		state = (quantile_state *) PG_GETARG_POINTER(0);
+
+	AssertCheckQuantileState(state);
+
+	state_append_datum(state, type, PG_GETARG_DATUM(1));
+
+	PG_RETURN_POINTER(state);
+}
+
+Datum
+quantile_buckets_append_double(PG_FUNCTION_ARGS)
+{
+	return buckets_append(fcinfo, QUANTILE_TYPE_DOUBLE,
+						  "quantile_buckets_append_double");
+}
+
+Datum
+quantile_buckets_append_int32(PG_FUNCTION_ARGS)
+{
+	return buckets_append(fcinfo, QUANTILE_TYPE_INT32,
+						  "quantile_buckets_append_int32");
+}
+
+Datum
+quantile_buckets_append_int64(PG_FUNCTION_ARGS)
+{
+	return buckets_append(fcinfo, QUANTILE_TYPE_INT64,
+						  "quantile_buckets_append_int64");
+}
+
+Datum
+quantile_buckets_append_numeric(PG_FUNCTION_ARGS)
+{
+	return buckets_append(fcinfo, QUANTILE_TYPE_NUMERIC,
+						  "quantile_buckets_append_numeric");
+}
+
+static Datum
+buckets_final(FunctionCallInfo fcinfo, int type)
+{
+	int				i;
+	quantile_state *state;
+	Size			elsize = quantile_type_size(type);
+	int				(*cmp) (const void *a, const void *b);
+	char		   *elements;
+	char		   *bounds;
+	int64		   *counts;
+	int				nbuckets;
+	int				pos = 0;
+	TupleDesc		tupdesc;
+	Datum			values[2];
+	bool			nulls[2] = {false, false};
+	ArrayBuildState *astate = NULL;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	state = (quantile_state *) PG_GETARG_POINTER(0);
+	nbuckets = state->nbuckets;
+
+	cmp = quantile_type_comparator(type);
+	elements = (char *) state->elements;
+
+	quantile_sort(elements, state->nelements, type);
+
+	bounds = palloc(elsize * (nbuckets + 1));
+	counts = (int64 *) palloc(sizeof(int64) * nbuckets);
+
+	/* the first boundary is the minimum */
+	memcpy(bounds, elements, elsize);
+
+	/*
+	 * Walk the sorted array just once - for each boundary, skip to the
+	 * last value equal to it, so that the counts are exact.
+	 */
+	for (i = 1; i <= nbuckets; i++)
+	{
+		int		start = pos;
+		int		idx = (int) ceil(state->nelements * ((double) i / nbuckets)) - 1;
+
+		Assert((idx >= 0) && (idx < state->nelements));
+
+		memcpy(bounds + i * elsize, elements + idx * elsize, elsize);
+
+		/* the boundary may be in a previous bucket (duplicate values) */
+		pos = Max(pos, idx + 1);
+
+		while ((pos < state->nelements) &&
+			   (cmp(elements + pos * elsize, bounds + i * elsize) == 0))
+			pos++;
+
+		counts[i-1] = pos - start;
+	}
+
+	Assert(pos == state->nelements);
+
+	values[0] = elements_to_array(fcinfo, type, bounds, nbuckets + 1);
+
+	for (i = 0; i < nbuckets; i++)
+		astate = accumArrayResult(astate, Int64GetDatum(counts[i]), false,
+								  INT8OID, CurrentMemoryContext);
+
+	values[1] = makeArrayResult(astate, CurrentMemoryContext);
+
+	tupdesc = BlessTupleDesc(tupdesc);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
+
+Datum
+quantile_buckets_double(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("quantile_buckets_double", fcinfo);
+
+	return buckets_final(fcinfo, QUANTILE_TYPE_DOUBLE);
+}
+
+Datum
+quantile_buckets_int32(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("quantile_buckets_int32", fcinfo);
+
+	return buckets_final(fcinfo, QUANTILE_TYPE_INT32);
+}
+
+Datum
+quantile_buckets_int64(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("quantile_buckets_int64", fcinfo);
+
+	return buckets_final(fcinfo, QUANTILE_TYPE_INT64);
+}
+
+Datum
+quantile_buckets_numeric(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("quantile_buckets_numeric", fcinfo);
+
+	return buckets_final(fcinfo, QUANTILE_TYPE_NUMERIC);
+}
+
+/*
+ * Approximate quantiles computed from a uniform random sample of at most
+ * sample_size values (reservoir sampling), so the memory consumption is
+ * bounded no matter how many rows there are. The final function returns
+ * the number of sampled values and the total number of (non-NULL) values
+ * along with the quantiles, so that the caller can judge the accuracy.
+ */
+static Datum
+sampled_append(FunctionCallInfo fcinfo, int type, const char *fname)
+{
+	quantile_state	   *state;
+	quantile_sampler   *sampler;
+
+	/* OK, we do want to skip NULL values altogether */
+	if (PG_ARGISNULL(1))
+	{
+		if (PG_ARGISNULL(0))
+			PG_RETURN_NULL();
+		else
+			/* if there already is a state accumulated, don't forget it */
+			PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	}
+
+	if (PG_ARGISNULL(0))
+	{
+		MemoryContext	oldcontext;
+		MemoryContext	aggcontext;
+
+		/* only look up the aggregate context when creating the state */
+		GET_AGG_CONTEXT(fname, fcinfo, aggcontext);
+
+		oldcontext = MemoryContextSwitchTo(aggcontext);
+
+		if (PG_ARGISNULL(2) || PG_ARGISNULL(3))
+			elog(ERROR, "quantiles and sample size must not be NULL");
+
+		if (PG_GETARG_INT32(3) < 1)
+			elog(ERROR, "invalid sample size - needs to be a positive integer");
+
+		sampler = (quantile_sampler *) palloc(sizeof(quantile_sampler));
+		sampler->samplesize = PG_GETARG_INT32(3);
+		sampler->nseen = 0;
+		sampler->nextsample = 0;
+		sampler->W = 0;
+
+#if (PG_VERSION_NUM >= 150000)
+		sampler->rngstate = pg_prng_uint64(&pg_global_prng_state);
+#else
+		sampler->rngstate = ((uint64) random() << 32) ^ (uint64) random();
+#endif
+
+		state = state_alloc(type, aggcontext,
+							Min(QUANTILE_MIN_ELEMENTS, sampler->samplesize), false);
+
+		state->sampler = sampler;
+
+		/* read the array of quantiles */
+		state->quantiles = array_to_double(fcinfo, PG_GETARG_ARRAYTYPE_P(2),
+										   &state->nquantiles);
+
+		check_quantiles(state->nquantiles, state->quantiles);
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+	else
+		state = (quantile_state *) PG_GETARG_POINTER(0);
+
+	AssertCheckQuantileState(state);
+
+	sampler = state->sampler;
+	sampler->nseen++;
+
+	if (state->nelements < sampler->samplesize)
+	{
+		/* still filling the reservoir (don't grow it over the sample size) */
+		if (state->nelements == state->maxelements)
+		{
+			state->maxelements = (int) Min((int64) state->maxelements * 2,
+										   sampler->samplesize);
+			state->elements = repalloc_huge(state->elements,
+											quantile_type_size(type) * state->maxelements);
+		}
+
+		state_append_datum(state, type, PG_GETARG_DATUM(1));
+
+		/* the reservoir just got full, so decide which value to sample next */
+		if (state->nelements == sampler->samplesize)
+		{
+			sampler->W = exp(log(sampler_random(sampler)) / sampler->samplesize);
+			sampler_skip(sampler);
+		}
+	}
+	else if (sampler->nseen == sampler->nextsample)
+	{
+		/* replace a random value in the reservoir */
+		int		idx = (int) (sampler_random_uint64(sampler) % sampler->samplesize);
+
+		if (type == QUANTILE_TYPE_NUMERIC)
+			pfree(((Numeric *) state->elements)[idx]);
+
+		state_set_datum(state, type, idx, PG_GETARG_DATUM(1));
+
+		sampler->W *= exp(log(sampler_random(sampler)) / sampler->samplesize);
+		sampler_skip(sampler);
+	}
+
+	PG_RETURN_POINTER(state);
+}
+
+Datum
+quantile_sampled_append_double(PG_FUNCTION_ARGS)
+{
+	return sampled_append(fcinfo, QUANTILE_TYPE_DOUBLE,
+						  "quantile_sampled_append_double");
+}
+
+Datum
+quantile_sampled_append_int32(PG_FUNCTION_ARGS)
+{
+	return sampled_append(fcinfo, QUANTILE_TYPE_INT32,
+						  "quantile_sampled_append_int32");
+}
+
+Datum
+quantile_sampled_append_int64(PG_FUNCTION_ARGS)
+{
+	return sampled_append(fcinfo, QUANTILE_TYPE_INT64,
+						  "quantile_sampled_append_int64");
+}
+
+Datum
+quantile_sampled_append_numeric(PG_FUNCTION_ARGS)
+{
+	return sampled_append(fcinfo, QUANTILE_TYPE_NUMERIC,
+						  "quantile_sampled_append_numeric");
+}
+
+static Datum
+sampled_final(FunctionCallInfo fcinfo, int type)
+{
+	int				i;
+	quantile_state *state;
+	Size			elsize = quantile_type_size(type);
+	char		   *result;
+	TupleDesc		tupdesc;
+	Datum			values[3];
+	bool			nulls[3] = {false, false, false};
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	state = (quantile_state *) PG_GETARG_POINTER(0);
+
+	quantile_sort(state->elements, state->nelements, type);
+
+	result = palloc(elsize * state->nquantiles);
+
+	for (i = 0; i < state->nquantiles; i++)
+	{
+		int	idx = 0;
+
+		if (state->quantiles[i] > 0)
+			idx = (int) ceil(state->nelements * state->quantiles[i]) - 1;
+
+		memcpy(result + i * elsize, (char *) state->elements + idx * elsize, elsize);
+	}
+
+	values[0] = elements_to_array(fcinfo, type, result, state->nquantiles);
+	values[1] = Int64GetDatum((int64) state->nelements);
+	values[2] = Int64GetDatum(state->sampler->nseen);
+
+	tupdesc = BlessTupleDesc(tupdesc);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
+
+Datum
+quantile_sampled_double(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("quantile_sampled_double", fcinfo);
+
+	return sampled_final(fcinfo, QUANTILE_TYPE_DOUBLE);
+}
+
+Datum
+quantile_sampled_int32(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("quantile_sampled_int32", fcinfo);
+
+	return sampled_final(fcinfo, QUANTILE_TYPE_INT32);
+}
+
+Datum
+quantile_sampled_int64(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("quantile_sampled_int64", fcinfo);
+
+	return sampled_final(fcinfo, QUANTILE_TYPE_INT64);
+}
+
+Datum
+quantile_sampled_numeric(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("quantile_sampled_numeric", fcinfo);
+
+	return sampled_final(fcinfo, QUANTILE_TYPE_NUMERIC);
+}
+
+/*
+ * Aggregating whole arrays of values (e.g. an array column), instead of
+ * calling the regular aggregate on unnest() output. The transition
+ * function copies all the values at once, so the per-value overhead of
+ * a function call is paid only once per array. The states are the same
+ * as for the regular quantile(value, quantiles[]) aggregates, so we
+ * simply reuse the final functions.
+ */
+static Datum
+array_agg_append(FunctionCallInfo fcinfo, int type, const char *fname)
+{
+	quantile_state *state;
+
+	char		   *values = NULL;
+	int				nvalues = 0;
+
+	/* the array itself is only needed while copying the values */
+	if (!PG_ARGISNULL(1))
+		values = array_values(PG_GETARG_ARRAYTYPE_P(1), type, &nvalues);
+
+	/* OK, we do want to skip NULL (and empty) arrays altogether */
+	if (PG_ARGISNULL(1) || (nvalues == 0))
+	{
+		if (PG_ARGISNULL(0))
+			PG_RETURN_NULL();
+		else
+			/* if there already is a state accumulated, don't forget it */
+			PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	}
+
+	if (PG_ARGISNULL(0))
+	{
+		MemoryContext	oldcontext;
+		MemoryContext	aggcontext;
+
+		if (PG_ARGISNULL(2))
+			elog(ERROR, "quantiles must not be NULL");
+
+		/* only look up the aggregate context when creating the state */
+		GET_AGG_CONTEXT(fname, fcinfo, aggcontext);
+
+		oldcontext = MemoryContextSwitchTo(aggcontext);
+
+		/* only int64/double values can be spilled (see quantile_make_room) */
+		state = state_alloc(type, aggcontext, QUANTILE_MIN_ELEMENTS,
+							((type == QUANTILE_TYPE_INT64) ||
+							 (type == QUANTILE_TYPE_DOUBLE)));
+		state->partial = partial_aggregate(fcinfo);
+
+		/* read the array of quantiles */
+		state->quantiles = array_to_double(fcinfo, PG_GETARG_ARRAYTYPE_P(2),
+										   &state->nquantiles);
+
+		check_quantiles(state->nquantiles, state->quantiles);
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+	else
+		state = (quantile_state *) PG_GETARG_POINTER(0);
+
+	AssertCheckQuantileState(state);
+
+	/* the array is enlarged in place, spilled via state->aggcontext */
+	state_append_values(state, type, values, nvalues);
+
+	PG_RETURN_POINTER(state);
+}
+
+Datum
+quantile_array_agg_append_double(PG_FUNCTION_ARGS)
+{
+	return array_agg_append(fcinfo, QUANTILE_TYPE_DOUBLE,
+							"quantile_array_agg_append_double");
+}
+
+Datum
+quantile_array_agg_append_int32(PG_FUNCTION_ARGS)
+{
+	return array_agg_append(fcinfo, QUANTILE_TYPE_INT32,
+							"quantile_array_agg_append_int32");
+}
+
+Datum
+quantile_array_agg_append_int64(PG_FUNCTION_ARGS)
+{
+	return array_agg_append(fcinfo, QUANTILE_TYPE_INT64,
+							"quantile_array_agg_append_int64");
+}
+
+/*
+ * Quantiles of values in a single array - a plain function, so there's
+ * no aggregate overhead at all. We sort a private copy of the array (or
+ * of the non-NULL values), and NULL values are ignored just like in the
+ * aggregates. Returns NULL if there are no non-NULL values.
+ */
+static Datum
+array_quantile(FunctionCallInfo fcinfo, int type)
+{
+	int			i;
+	Size		elsize = quantile_type_size(type);
+	ArrayType  *array = PG_GETARG_ARRAYTYPE_P_COPY(0);
+	char	   *values;
+	int			nvalues;
+	double	   *quantiles;
+	int			nquantiles;
+	char	   *result;
+
+	quantiles = array_to_double(fcinfo, PG_GETARG_ARRAYTYPE_P(1), &nquantiles);
+
+	check_quantiles(nquantiles, quantiles);
+
+	values = array_values(array, type, &nvalues);
+
+	if (nvalues == 0)
+		PG_RETURN_NULL();
+
+	quantile_sort(values, nvalues, type);
+
+	result = palloc(elsize * nquantiles);
+
+	for (i = 0; i < nquantiles; i++)
+	{
+		int	idx = 0;
+
+		if (quantiles[i] > 0)
+			idx = (int) ceil(nvalues * quantiles[i]) - 1;
+
+		memcpy(result + i * elsize, values + idx * elsize, elsize);
+	}
+
+	return elements_to_array(fcinfo, type, result, nquantiles);
+}
+
+Datum
+array_quantile_double(PG_FUNCTION_ARGS)
+{
+	return array_quantile(fcinfo, QUANTILE_TYPE_DOUBLE);
+}
+
+Datum
+array_quantile_int32(PG_FUNCTION_ARGS)
+{
+	return array_quantile(fcinfo, QUANTILE_TYPE_INT32);
+}
+
+Datum
+array_quantile_int64(PG_FUNCTION_ARGS)
+{
+	return array_quantile(fcinfo, QUANTILE_TYPE_INT64);
+}
+
+/*
+ * Parallel aggregation for the quantile aggregates. The workers sort their
+ * values while serializing the state, so each partial state arrives as a
+ * sorted run. The combine function only collects the runs (without any
+ * copying or merging), and the final function then selects the requested
+ * ranks across all the runs using binary searches, so the leader does not
+ * have to sort all the values again.
+ *
+ * With quantile.spill_mem set, the leader writes the int64/double runs to
+ * its own spill file once they exceed half of the limit (the same amount
+ * of memory quantile_make_room allows for the elements array). That only
+ * applies to the quantile aggregates, as the other final functions using
+ * the same state (e.g. quantile_distinct) can't read spilled values.
+ */
+static Datum
+state_combine(FunctionCallInfo fcinfo, int type, const char *fname)
+{
+	int				i;
+	quantile_state *src;
+	quantile_state *dst;
+	MemoryContext	aggcontext;
+	MemoryContext	oldcontext;
+
+	GET_AGG_CONTEXT(fname, fcinfo, aggcontext);
+
+	if (PG_ARGISNULL(1))
+	{
+		if (PG_ARGISNULL(0))
+			PG_RETURN_NULL();
+
+		PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	}
+
+	src = (quantile_state *) PG_GETARG_POINTER(1);
+
+	oldcontext = MemoryContextSwitchTo(aggcontext);
+
+	/*
+	 * Partial aggregation always serializes internal states, so the state
+	 * comes from state_deserialize, which allocates it (including the runs)
+	 * in the aggregate context. We can keep it without copying it.
+	 */
+	if (PG_ARGISNULL(0))
+		dst = src;
+	else
+	{
+		dst = (quantile_state *) PG_GETARG_POINTER(0);
+
+		/*
+		 * Deserialized states have all values in sorted runs, but handle
+		 * unsorted (and spilled) values too, so that the function works
+		 * with states built by the transition functions.
+		 */
+		if (src->nelements > 0)
+		{
+			quantile_sort(src->elements, src->nelements, type);
+
+			state_add_run(dst, src->elements, src->nelements);
+		}
+
+		for (i = 0; i < src->nruns; i++)
+			state_add_run(dst, src->runs[i].elements, src->runs[i].nelements);
+
+		if (src->spill != NULL)
+			spill_copy(dst, src, (type == QUANTILE_TYPE_DOUBLE));
+	}
+
+	if (dst->spillable)
+	{
+		int64	nelements = dst->nelements;
+
+		for (i = 0; i < dst->nruns; i++)
+			nelements += dst->runs[i].nelements;
+
+		if ((dst->spill != NULL) ||
+			((quantile_spill_mem > 0) &&
+			 (nelements * sizeof(int64) > (Size) quantile_spill_mem * 1024L / 2)))
+			spill_runs(dst, (type == QUANTILE_TYPE_DOUBLE));
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+
+	PG_RETURN_POINTER(dst);
+}
+
+/*
+ * Serialize the state into a bytea value. The in-memory values are sorted
+ * and sent as a run (along with runs the state may already have).
+ *
+ * Partial states are never spilled to a temporary file (quantile_make_room
+ * sorts the values into runs instead), so all the values are in memory.
+ * States too large for a bytea value (1GB) can't be serialized, though.
+ */
+static Datum
+state_serialize(FunctionCallInfo fcinfo, int type, const char *fname)
+{
+	int				i;
+	quantile_state *state;
+	bool			sorted;
+	StringInfoData	buf;
+
+	CHECK_AGG_CONTEXT(fname, fcinfo);
+
+	state = (quantile_state *) PG_GETARG_POINTER(0);
+
+	Assert(state->spill == NULL);
+
+	sorted = (state->nelements > 0);
+
+	pq_begintypsend(&buf);
+
+	pq_sendint32(&buf, state->nquantiles);
+	for (i = 0; i < state->nquantiles; i++)
+		pq_sendfloat8(&buf, state->quantiles[i]);
+
+	pq_sendbyte(&buf, state->spillable ? 1 : 0);
+
+	pq_sendint32(&buf, state->nruns + (sorted ? 1 : 0));
+
+	for (i = 0; i < state->nruns; i++)
+	{
+		pq_sendint32(&buf, state->runs[i].nelements);
+
+		send_sorted_values(&buf, type, (char *) state->runs[i].elements,
+						   state->runs[i].nelements);
+	}
+
+	if (sorted)
+	{
+		quantile_sort(state->elements, state->nelements, type);
+
+		pq_sendint32(&buf, state->nelements);
+
+		send_sorted_values(&buf, type, (char *) state->elements,
+						   state->nelements);
+	}
+
+	PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+/*
+ * Deserialize the state. It's allocated in the aggregate context, so that
+ * the combine function can keep the runs without copying them.
+ */
+static Datum
+state_deserialize(FunctionCallInfo fcinfo, int type, const char *fname)
+{
+	int				i;
+	bytea		   *sstate;
+	quantile_state *state;
+	Size			elsize = quantile_type_size(type);
+	StringInfoData	buf;
+	MemoryContext	aggcontext;
+	MemoryContext	oldcontext;
+
+	GET_AGG_CONTEXT(fname, fcinfo, aggcontext);
+
+	sstate = PG_GETARG_BYTEA_PP(0);
+
+	initStringInfo(&buf);
+	appendBinaryStringInfo(&buf, VARDATA_ANY(sstate),
+						   VARSIZE_ANY_EXHDR(sstate));
+
+	oldcontext = MemoryContextSwitchTo(aggcontext);
+
+	/* all the values are in the runs, the elements array starts empty */
+	state = state_alloc(type, aggcontext, QUANTILE_MIN_ELEMENTS, false);
+
+	state->nquantiles = pq_getmsgint(&buf, 4);
+	state->quantiles = (double *) palloc(sizeof(double) * state->nquantiles);
+	for (i = 0; i < state->nquantiles; i++)
+		state->quantiles[i] = pq_getmsgfloat8(&buf);
+
+	state->spillable = (pq_getmsgbyte(&buf) != 0);
+
+	state->nruns = pq_getmsgint(&buf, 4);
+	state->maxruns = Max(state->nruns, 1);
+	state->runs = (quantile_run *) palloc(sizeof(quantile_run) * state->maxruns);
+
+	for (i = 0; i < state->nruns; i++)
+	{
+		quantile_run   *run = &state->runs[i];
+
+		run->nelements = pq_getmsgint(&buf, 4);
+		run->elements = MemoryContextAllocHuge(aggcontext,
+											   elsize * Max(run->nelements, 1));
+
+		recv_sorted_values(&buf, type, (char *) run->elements, run->nelements);
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+
+	pq_getmsgend(&buf);
+	pfree(buf.data);
+
+	PG_RETURN_POINTER(state);
+}
+
+Datum
+quantile_combine_double(PG_FUNCTION_ARGS)
+{
+	return state_combine(fcinfo, QUANTILE_TYPE_DOUBLE, "quantile_combine_double");
+}
+
+Datum
+quantile_combine_int32(PG_FUNCTION_ARGS)
+{
+	return state_combine(fcinfo, QUANTILE_TYPE_INT32, "quantile_combine_int32");
+}
+
+Datum
+quantile_combine_int64(PG_FUNCTION_ARGS)
+{
+	return state_combine(fcinfo, QUANTILE_TYPE_INT64, "quantile_combine_int64");
+}
+
+Datum
+quantile_combine_numeric(PG_FUNCTION_ARGS)
+{
+	return state_combine(fcinfo, QUANTILE_TYPE_NUMERIC, "quantile_combine_numeric");
+}
+
+Datum
+quantile_serialize_double(PG_FUNCTION_ARGS)
+{
+	return state_serialize(fcinfo, QUANTILE_TYPE_DOUBLE, "quantile_serialize_double");
+}
+
+Datum
+quantile_serialize_int32(PG_FUNCTION_ARGS)
+{
+	return state_serialize(fcinfo, QUANTILE_TYPE_INT32, "quantile_serialize_int32");
+}
+
+Datum
+quantile_serialize_int64(PG_FUNCTION_ARGS)
+{
+	return state_serialize(fcinfo, QUANTILE_TYPE_INT64, "quantile_serialize_int64");
+}
+
+Datum
+quantile_serialize_numeric(PG_FUNCTION_ARGS)
+{
+	return state_serialize(fcinfo, QUANTILE_TYPE_NUMERIC, "quantile_serialize_numeric");
+}
+
+Datum
+quantile_deserialize_double(PG_FUNCTION_ARGS)
+{
+	return state_deserialize(fcinfo, QUANTILE_TYPE_DOUBLE, "quantile_deserialize_double");
+}
+
+Datum
+quantile_deserialize_int32(PG_FUNCTION_ARGS)
+{
+	return state_deserialize(fcinfo, QUANTILE_TYPE_INT32, "quantile_deserialize_int32");
+}
+
+Datum
+quantile_deserialize_int64(PG_FUNCTION_ARGS)
+{
+	return state_deserialize(fcinfo, QUANTILE_TYPE_INT64, "quantile_deserialize_int64");
+}
+
+Datum
+quantile_deserialize_numeric(PG_FUNCTION_ARGS)
+{
+	return state_deserialize(fcinfo, QUANTILE_TYPE_NUMERIC, "quantile_deserialize_numeric");
+}
+
+/*
+ * Storable states - quantile_state_agg() collects the values just like the
+ * quantile aggregates, but returns them as a sorted array in a varlena (of
+ * type quantile_state_double etc.), which can be stored in a table. The
+ * quantile_merge() aggregates then combine such states - either into a new
+ * state, or directly into quantiles. That allows computing higher levels
+ * of a rollup from the lower ones, without re-reading the raw data. The
+ * stored states are added as sorted runs, just like partial states in a
+ * parallel query, so they don't need to be sorted again.
+ */
+static Datum
+state_agg_append(FunctionCallInfo fcinfo, int type, const char *fname)
+{
+	quantile_state *state;
+
+	/* OK, we do want to skip NULL values altogether */
+	if (PG_ARGISNULL(1))
+	{
+		if (PG_ARGISNULL(0))
+			PG_RETURN_NULL();
+		else
+			/* if there already is a state accumulated, don't forget it */
+			PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	}
+
+	if (PG_ARGISNULL(0))
+	{
+		MemoryContext	oldcontext;
+		MemoryContext	aggcontext;
+
+		/* only look up the aggregate context when creating the state */
+		GET_AGG_CONTEXT(fname, fcinfo, aggcontext);
+
+		oldcontext = MemoryContextSwitchTo(aggcontext);
+
+		/* no quantiles, we only collect the values */
+		state = state_alloc(type, aggcontext, QUANTILE_MIN_ELEMENTS, false);
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+	else
+		state = (quantile_state *) PG_GETARG_POINTER(0);
+
+	state_append_datum(state, type, PG_GETARG_DATUM(1));
+
+	PG_RETURN_POINTER(state);
+}
+
+Datum
+quantile_state_agg_append_double(PG_FUNCTION_ARGS)
+{
+	return state_agg_append(fcinfo, QUANTILE_TYPE_DOUBLE,
+							"quantile_state_agg_append_double");
+}
+
+Datum
+quantile_state_agg_append_int32(PG_FUNCTION_ARGS)
+{
+	return state_agg_append(fcinfo, QUANTILE_TYPE_INT32,
+							"quantile_state_agg_append_int32");
+}
+
+Datum
+quantile_state_agg_append_int64(PG_FUNCTION_ARGS)
+{
+	return state_agg_append(fcinfo, QUANTILE_TYPE_INT64,
+							"quantile_state_agg_append_int64");
+}
+
+Datum
+quantile_state_agg_append_numeric(PG_FUNCTION_ARGS)
+{
+	return state_agg_append(fcinfo, QUANTILE_TYPE_NUMERIC,
+							"quantile_state_agg_append_numeric");
+}
+
+/*
+ * Add a stored state to the aggregate state, as a sorted run. The variant
+ * returning quantiles directly gets the array of quantiles as the third
+ * argument (and uses the regular final functions).
+ */
+static Datum
+merge_append(FunctionCallInfo fcinfo, int type, const char *fname)
+{
+	quantile_state *state;
+	bytea		   *stored;
+	char		   *values;
+	int				nvalues;
+
+	MemoryContext	oldcontext;
+	MemoryContext	aggcontext;
+
+	/* OK, we do want to skip NULL states altogether */
+	if (PG_ARGISNULL(1))
+	{
+		if (PG_ARGISNULL(0))
+			PG_RETURN_NULL();
+		else
+			/* if there already is a state accumulated, don't forget it */
+			PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	}
+
+	GET_AGG_CONTEXT(fname, fcinfo, aggcontext);
+
+	/* detoast in the per-call context, only the decoded values are kept */
+	stored = PG_GETARG_BYTEA_PP(1);
+
+	oldcontext = MemoryContextSwitchTo(aggcontext);
+
+	values = stored_state_decode(stored, type, &nvalues);
+
+	PG_FREE_IF_COPY(stored, 1);
+
+	/* states without any values are treated just like NULL */
+	if (nvalues == 0)
+	{
+		pfree(values);
+
+		MemoryContextSwitchTo(oldcontext);
+
+		if (PG_ARGISNULL(0))
+			PG_RETURN_NULL();
+
+		PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	}
+
+	if (PG_ARGISNULL(0))
+	{
+		state = state_alloc(type, aggcontext, QUANTILE_MIN_ELEMENTS, false);
+
+		/* read the array of quantiles */
+		if (PG_NARGS() > 2)
+		{
+			if (PG_ARGISNULL(2))
+				elog(ERROR, "quantiles must not be NULL");
+
+			state->quantiles = array_to_double(fcinfo, PG_GETARG_ARRAYTYPE_P(2),
+											   &state->nquantiles);
+
+			check_quantiles(state->nquantiles, state->quantiles);
+		}
+	}
+	else
+		state = (quantile_state *) PG_GETARG_POINTER(0);
+
+	state_add_run(state, values, nvalues);
+
+	MemoryContextSwitchTo(oldcontext);
+
+	PG_RETURN_POINTER(state);
+}
+
+Datum
+quantile_merge_append_double(PG_FUNCTION_ARGS)
+{
+	return merge_append(fcinfo, QUANTILE_TYPE_DOUBLE, "quantile_merge_append_double");
+}
+
+Datum
+quantile_merge_append_int32(PG_FUNCTION_ARGS)
+{
+	return merge_append(fcinfo, QUANTILE_TYPE_INT32, "quantile_merge_append_int32");
+}
+
+Datum
+quantile_merge_append_int64(PG_FUNCTION_ARGS)
+{
+	return merge_append(fcinfo, QUANTILE_TYPE_INT64, "quantile_merge_append_int64");
+}
+
+Datum
+quantile_merge_append_numeric(PG_FUNCTION_ARGS)
+{
+	return merge_append(fcinfo, QUANTILE_TYPE_NUMERIC, "quantile_merge_append_numeric");
+}
+
+/*
+ * Final function for quantile_state_agg (and quantile_merge without the
+ * quantiles) - merge everything into a single sorted array of values.
+ */
+static Datum
+state_agg_final(FunctionCallInfo fcinfo, int type)
+{
+	quantile_state *state;
+	char		   *values;
+	int				nvalues;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	state = (quantile_state *) PG_GETARG_POINTER(0);
+
+	values = state_sorted_values(state, type, &nvalues);
+
+	PG_RETURN_BYTEA_P(stored_state_encode(type, values, nvalues));
+}
+
+Datum
+quantile_state_agg_double(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("quantile_state_agg_double", fcinfo);
+
+	return state_agg_final(fcinfo, QUANTILE_TYPE_DOUBLE);
+}
+
+Datum
+quantile_state_agg_int32(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("quantile_state_agg_int32", fcinfo);
+
+	return state_agg_final(fcinfo, QUANTILE_TYPE_INT32);
+}
+
+Datum
+quantile_state_agg_int64(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("quantile_state_agg_int64", fcinfo);
+
+	return state_agg_final(fcinfo, QUANTILE_TYPE_INT64);
+}
+
+Datum
+quantile_state_agg_numeric(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("quantile_state_agg_numeric", fcinfo);
+
+	return state_agg_final(fcinfo, QUANTILE_TYPE_NUMERIC);
+}
+
+/*
+ * Functions maintaining the storable states directly - adding a batch of
+ * new values, removing a batch of (e.g. expired) values, and getting the
+ * quantiles. That allows keeping e.g. a sliding window up to date without
+ * aggregating the raw data again. The batch is sorted and then merged with
+ * the sorted values from the state, so that's O(n + m log m) for a state
+ * with n values and a batch with m values. NULL values are ignored.
+ */
+static Datum
+stored_state_add(FunctionCallInfo fcinfo, int type)
+{
+	char	   *values = NULL;
+	int			nvalues = 0;
+	char	   *batch;
+	int			nbatch;
+	char	   *result;
+	int			i = 0,
+				j = 0,
+				n = 0;
+	Size		elsize = quantile_type_size(type);
+	int			(*cmp) (const void *a, const void *b) = quantile_type_comparator(type);
+
+	/* nothing to add, keep the state as it is */
+	if (PG_ARGISNULL(1))
+	{
+		if (PG_ARGISNULL(0))
+			PG_RETURN_NULL();
+
+		PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	}
+
+	/* a NULL state is the same as an empty one */
+	if (!PG_ARGISNULL(0))
+		values = stored_state_decode(PG_GETARG_BYTEA_PP(0), type, &nvalues);
+
+	/* we'll sort the batch, so make sure we have a private copy */
+	batch = array_values(PG_GETARG_ARRAYTYPE_P_COPY(1), type, &nbatch);
+
+	quantile_sort(batch, nbatch, type);
+
+	if ((int64) nvalues + nbatch > INT_MAX)
+		elog(ERROR, "too many values in the quantile state");
+
+	result = MemoryContextAllocHuge(CurrentMemoryContext,
+									elsize * Max(nvalues + nbatch, 1));
+
+	while ((i < nvalues) || (j < nbatch))
+	{
+		if ((j == nbatch) ||
+			((i < nvalues) && (cmp(values + (Size) i * elsize,
+								   batch + (Size) j * elsize) <= 0)))
+			memcpy(result + (Size) (n++) * elsize,
+				   values + (Size) (i++) * elsize, elsize);
+		else
+			memcpy(result + (Size) (n++) * elsize,
+				   batch + (Size) (j++) * elsize, elsize);
+	}
+
+	PG_RETURN_BYTEA_P(stored_state_encode(type, result, n));
+}
+
+static Datum
+stored_state_remove(FunctionCallInfo fcinfo, int type)
+{
+	char	   *values;
+	int			nvalues;
+	char	   *batch;
+	int			nbatch;
+	char	   *result;
+	int			i = 0,
+				j = 0,
+				n = 0;
+	Size		elsize = quantile_type_size(type);
+	int			(*cmp) (const void *a, const void *b) = quantile_type_comparator(type);
+
+	values = stored_state_decode(PG_GETARG_BYTEA_PP(0), type, &nvalues);
+
+	batch = array_values(PG_GETARG_ARRAYTYPE_P_COPY(1), type, &nbatch);
+
+	quantile_sort(batch, nbatch, type);
+
+	result = MemoryContextAllocHuge(CurrentMemoryContext,
+									elsize * Max(nvalues, 1));
+
+	/* remove one occurrence of each value in the batch */
+	while (i < nvalues)
+	{
+		int		c = -1;
+
+		if (j < nbatch)
+			c = cmp(values + (Size) i * elsize, batch + (Size) j * elsize);
+
+		if (c > 0)
+			break;
+
+		if (c == 0)
+			j++;
+		else
+			memcpy(result + (Size) (n++) * elsize,
+				   values + (Size) i * elsize, elsize);
+
+		i++;
+	}
+
+	if (j < nbatch)
+		elog(ERROR, "value to remove not found in the quantile state");
+
+	PG_RETURN_BYTEA_P(stored_state_encode(type, result, n));
+}
+
+static Datum
+stored_state_get(FunctionCallInfo fcinfo, int type)
+{
+	int			i;
+	char	   *values;
+	int			nvalues;
+	double	   *quantiles;
+	int			nquantiles;
+	char	   *result;
+	Size		elsize = quantile_type_size(type);
+
+	quantiles = array_to_double(fcinfo, PG_GETARG_ARRAYTYPE_P(1), &nquantiles);
+
+	check_quantiles(nquantiles, quantiles);
+
+	values = stored_state_decode(PG_GETARG_BYTEA_PP(0), type, &nvalues);
+
+	if (nvalues == 0)
+		PG_RETURN_NULL();
+
+	result = palloc(elsize * nquantiles);
+
+	for (i = 0; i < nquantiles; i++)
+	{
+		int	idx = 0;
+
+		if (quantiles[i] > 0)
+			idx = (int) ceil(nvalues * quantiles[i]) - 1;
+
+		memcpy(result + i * elsize, values + (Size) idx * elsize, elsize);
+	}
+
+	return elements_to_array(fcinfo, type, result, nquantiles);
+}
+
+Datum
+quantile_state_add_double(PG_FUNCTION_ARGS)
+{
+	return stored_state_add(fcinfo, QUANTILE_TYPE_DOUBLE);
+}
+
+Datum
+quantile_state_add_int32(PG_FUNCTION_ARGS)
+{
+	return stored_state_add(fcinfo, QUANTILE_TYPE_INT32);
+}
+
+Datum
+quantile_state_add_int64(PG_FUNCTION_ARGS)
+{
+	return stored_state_add(fcinfo, QUANTILE_TYPE_INT64);
+}
+
+Datum
+quantile_state_add_numeric(PG_FUNCTION_ARGS)
+{
+	return stored_state_add(fcinfo, QUANTILE_TYPE_NUMERIC);
+}
+
+Datum
+quantile_state_remove_double(PG_FUNCTION_ARGS)
+{
+	return stored_state_remove(fcinfo, QUANTILE_TYPE_DOUBLE);
+}
+
+Datum
+quantile_state_remove_int32(PG_FUNCTION_ARGS)
+{
+	return stored_state_remove(fcinfo, QUANTILE_TYPE_INT32);
+}
+
+Datum
+quantile_state_remove_int64(PG_FUNCTION_ARGS)
+{
+	return stored_state_remove(fcinfo, QUANTILE_TYPE_INT64);
+}
+
+Datum
+quantile_state_remove_numeric(PG_FUNCTION_ARGS)
+{
+	return stored_state_remove(fcinfo, QUANTILE_TYPE_NUMERIC);
+}
+
+Datum
+quantile_state_get_double(PG_FUNCTION_ARGS)
+{
+	return stored_state_get(fcinfo, QUANTILE_TYPE_DOUBLE);
+}
+
+Datum
+quantile_state_get_int32(PG_FUNCTION_ARGS)
+{
+	return stored_state_get(fcinfo, QUANTILE_TYPE_INT32);
+}
+
+Datum
+quantile_state_get_int64(PG_FUNCTION_ARGS)
+{
+	return stored_state_get(fcinfo, QUANTILE_TYPE_INT64);
+}
+
+Datum
+quantile_state_get_numeric(PG_FUNCTION_ARGS)
+{
+	return stored_state_get(fcinfo, QUANTILE_TYPE_NUMERIC);
+}
+
+/*
+ * Quantiles of distinct values. With quantile(DISTINCT x, ...) the executor
+ * sorts the input to remove duplicates before passing it to the transition
+ * function, and then we sort the values again. Instead, we remove the
+ * duplicates ourselves - whenever the array of values gets full, it gets
+ * sorted and compacted, and it's only enlarged if that did not free at
+ * least half of it. For data with many duplicates the array stays small,
+ * and the final function then sorts and compacts it once more.
+ */
+static Datum
+distinct_append(FunctionCallInfo fcinfo, int type, const char *fname)
+{
+	quantile_state *state;
+
+	/* OK, we do want to skip NULL values altogether */
+	if (PG_ARGISNULL(1))
+	{
+		if (PG_ARGISNULL(0))
+			PG_RETURN_NULL();
+		else
+			/* if there already is a state accumulated, don't forget it */
+			PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	}
+
+	if (PG_ARGISNULL(0))
+	{
+		MemoryContext	oldcontext;
+		MemoryContext	aggcontext;
+
+		/* only look up the aggregate context when creating the state */
+		GET_AGG_CONTEXT(fname, fcinfo, aggcontext);
+
+		oldcontext = MemoryContextSwitchTo(aggcontext);
+
+		state = state_alloc(type, aggcontext, QUANTILE_MIN_ELEMENTS, false);
+
+		/* read the array of quantiles */
+		state->quantiles = array_to_double(fcinfo, PG_GETARG_ARRAYTYPE_P(2),
+										   &state->nquantiles);
+
+		check_quantiles(state->nquantiles, state->quantiles);
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+	else
+		state = (quantile_state *) PG_GETARG_POINTER(0);
+
+	/* full array - remove the duplicates, grow if that did not help much */
+	if (state->nelements == state->maxelements)
+	{
+		quantile_sort(state->elements, state->nelements, type);
+
+		state->nelements = distinct_compact(state->elements, state->nelements,
+											type, true);
+
+		if (state->nelements > state->maxelements / 2)
+			state_grow(state, quantile_type_size(type),
+					   (int64) state->maxelements + 1);
+	}
+
+	state_append_datum(state, type, PG_GETARG_DATUM(1));
+
+	PG_RETURN_POINTER(state);
+}
+
+Datum
+quantile_distinct_append_double(PG_FUNCTION_ARGS)
+{
+	return distinct_append(fcinfo, QUANTILE_TYPE_DOUBLE,
+						   "quantile_distinct_append_double");
+}
+
+Datum
+quantile_distinct_append_int32(PG_FUNCTION_ARGS)
+{
+	return distinct_append(fcinfo, QUANTILE_TYPE_INT32,
+						   "quantile_distinct_append_int32");
+}
+
+Datum
+quantile_distinct_append_int64(PG_FUNCTION_ARGS)
+{
+	return distinct_append(fcinfo, QUANTILE_TYPE_INT64,
+						   "quantile_distinct_append_int64");
+}
+
+Datum
+quantile_distinct_append_numeric(PG_FUNCTION_ARGS)
+{
+	return distinct_append(fcinfo, QUANTILE_TYPE_NUMERIC,
+						   "quantile_distinct_append_numeric");
+}
+
+static Datum
+distinct_final(FunctionCallInfo fcinfo, int type)
+{
+	int				i;
+	quantile_state *state;
+	char		   *values;
+	int				nvalues;
+	char		   *result;
+	Size			elsize = quantile_type_size(type);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	state = (quantile_state *) PG_GETARG_POINTER(0);
+
+	/* merge the runs from parallel workers (or just sort the values) */
+	values = state_sorted_values(state, type, &nvalues);
+
+	nvalues = distinct_compact(values, nvalues, type, false);
+
+	/* the in-memory values were compacted in place */
+	if (values == (char *) state->elements)
+		state->nelements = nvalues;
+
+	result = palloc(elsize * state->nquantiles);
+
+	for (i = 0; i < state->nquantiles; i++)
+	{
+		int	idx = 0;
+
+		if (state->quantiles[i] > 0)
+			idx = (int) ceil(nvalues * state->quantiles[i]) - 1;
+
+		memcpy(result + i * elsize, values + (Size) idx * elsize, elsize);
+	}
+
+	return elements_to_array(fcinfo, type, result, state->nquantiles);
+}
+
+Datum
+quantile_distinct_double(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("quantile_distinct_double", fcinfo);
+
+	return distinct_final(fcinfo, QUANTILE_TYPE_DOUBLE);
+}
+
+Datum
+quantile_distinct_int32(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("quantile_distinct_int32", fcinfo);
+
+	return distinct_final(fcinfo, QUANTILE_TYPE_INT32);
+}
+
+Datum
+quantile_distinct_int64(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("quantile_distinct_int64", fcinfo);
+
+	return distinct_final(fcinfo, QUANTILE_TYPE_INT64);
+}
+
+Datum
+quantile_distinct_numeric(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("quantile_distinct_numeric", fcinfo);
+
+	return distinct_final(fcinfo, QUANTILE_TYPE_NUMERIC);
+}
+
+/*
+ * Quantiles of multiple columns, passed as an array with one value per
+ * column. That's much cheaper than a separate quantile() aggregate for
+ * each column - we parse the quantiles and look up the aggregate context
+ * once per group (not once per group and column), and there's a single
+ * transition call per row. The values are appended to per-column buffers,
+ * and the final function returns a 2-D array with a row of quantiles for
+ * each column.
+ */
+Datum
+quantile_columns_append(PG_FUNCTION_ARGS)
+{
+	int				i;
+	quantile_columns_state *state;
+	ArrayType	   *row;
+	int				nvalues;
+	double		   *values;
+	bits8		   *bitmap;
+	int				bitmask;
+
+	/* the array is only needed while copying the values */
+	row = PG_ARGISNULL(1) ? NULL : PG_GETARG_ARRAYTYPE_P(1);
+
+	/* OK, we do want to skip NULL (and empty) rows altogether */
+	if ((row == NULL) ||
+		(ArrayGetNItems(ARR_NDIM(row), ARR_DIMS(row)) == 0))
+	{
+		if (PG_ARGISNULL(0))
+			PG_RETURN_NULL();
+		else
+			/* if there already is a state accumulated, don't forget it */
+			PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	}
+
+	if (ARR_ELEMTYPE(row) != FLOAT8OID)
+		elog(ERROR, "unexpected array element type %u (expected %u)",
+			 ARR_ELEMTYPE(row), FLOAT8OID);
+
+	nvalues = ArrayGetNItems(ARR_NDIM(row), ARR_DIMS(row));
+
+	if (PG_ARGISNULL(0))
+	{
+		MemoryContext	aggcontext;
+		MemoryContext	oldcontext;
+		double		   *quantiles;
+		int				nquantiles;
+
+		GET_AGG_CONTEXT("quantile_columns_append", fcinfo, aggcontext);
+
+		if (PG_ARGISNULL(2))
+			elog(ERROR, "quantiles must not be NULL");
+
+		oldcontext = MemoryContextSwitchTo(aggcontext);
+
+		/* read the array of quantiles */
+		quantiles = array_to_double(fcinfo, PG_GETARG_ARRAYTYPE_P(2),
+									&nquantiles);
+
+		check_quantiles(nquantiles, quantiles);
+
+		state = columns_state_create(nvalues, nquantiles, quantiles);
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+	else
+		state = (quantile_columns_state *) PG_GETARG_POINTER(0);
+
+	if (nvalues != state->ncolumns)
+		elog(ERROR, "all rows must have the same number of values (%d != %d)",
+			 nvalues, state->ncolumns);
+
+	/* the values are packed, the NULL ones are only in the bitmap */
+	values = (double *) ARR_DATA_PTR(row);
+	bitmap = ARR_HASNULL(row) ? ARR_NULLBITMAP(row) : NULL;
+	bitmask = 1;
+
+	for (i = 0; i < nvalues; i++)
+	{
+		if ((bitmap == NULL) || (*bitmap & bitmask))
+		{
+			if (state->nelements[i] == state->maxelements[i])
+				columns_grow(state, i, (int64) state->nelements[i] + 1);
+
+			state->columns[i][state->nelements[i]++] = *values++;
+		}
+
+		if (bitmap != NULL)
+		{
+			bitmask <<= 1;
+			if (bitmask == 0x100)
+			{
+				bitmap++;
+				bitmask = 1;
+			}
+		}
+	}
+
+	PG_RETURN_POINTER(state);
+}
+
+Datum
+quantile_columns_final(PG_FUNCTION_ARGS)
+{
+	int				i,
+					j;
+	quantile_columns_state *state;
+	Datum		   *result;
+	bool		   *nulls;
+	int				dims[2];
+	int				lbs[2];
+
+	CHECK_AGG_CONTEXT("quantile_columns_final", fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	state = (quantile_columns_state *) PG_GETARG_POINTER(0);
+
+	result = (Datum *) palloc(sizeof(Datum) * state->ncolumns * state->nquantiles);
+	nulls = (bool *) palloc(sizeof(bool) * state->ncolumns * state->nquantiles);
+
+	for (i = 0; i < state->ncolumns; i++)
+	{
+		double *values = state->columns[i];
+		int		nvalues = state->nelements[i];
+
+		/* columns with only NULL values get NULL quantiles */
+		if (nvalues > 0)
+			quantile_sort(values, nvalues, QUANTILE_TYPE_DOUBLE);
+
+		for (j = 0; j < state->nquantiles; j++)
+		{
+			int		idx = 0;
+			int		k = i * state->nquantiles + j;
+
+			nulls[k] = (nvalues == 0);
+			result[k] = (Datum) 0;
+
+			if (nvalues == 0)
+				continue;
+
+			if (state->quantiles[j] > 0)
+				idx = (int) ceil(nvalues * state->quantiles[j]) - 1;
+
+			result[k] = Float8GetDatum(values[idx]);
+		}
+	}
+
+	dims[0] = state->ncolumns;
+	dims[1] = state->nquantiles;
+	lbs[0] = 1;
+	lbs[1] = 1;
+
+	PG_RETURN_ARRAYTYPE_P(construct_md_array(result, nulls, 2, dims, lbs,
+											 FLOAT8OID, sizeof(float8),
+											 FLOAT8PASSBYVAL, 'd'));
+}
+
+/*
+ * Parallel aggregation for quantile_columns. The workers sort the columns
+ * while serializing the state (so that we can use the delta encoding),
+ * and the combine function simply appends them to the columns.
+ */
+Datum
+quantile_columns_combine(PG_FUNCTION_ARGS)
+{
+	int				i;
+	quantile_columns_state *src;
+	quantile_columns_state *dst;
+
+	CHECK_AGG_CONTEXT("quantile_columns_combine", fcinfo);
+
+	if (PG_ARGISNULL(1))
+	{
+		if (PG_ARGISNULL(0))
+			PG_RETURN_NULL();
+
+		PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	}
+
+	src = (quantile_columns_state *) PG_GETARG_POINTER(1);
+
+	/* deserialized states are allocated in the aggregate context */
+	if (PG_ARGISNULL(0))
+		PG_RETURN_POINTER(src);
+
+	dst = (quantile_columns_state *) PG_GETARG_POINTER(0);
+
+	if (src->ncolumns != dst->ncolumns)
+		elog(ERROR, "all rows must have the same number of values (%d != %d)",
+			 src->ncolumns, dst->ncolumns);
+
+	for (i = 0; i < src->ncolumns; i++)
+	{
+		if (src->nelements[i] == 0)
+			continue;
+
+		/* the buffers are in the aggregate context, so no need to switch */
+		columns_grow(dst, i, (int64) dst->nelements[i] + src->nelements[i]);
+
+		memcpy(dst->columns[i] + dst->nelements[i], src->columns[i],
+			   sizeof(double) * src->nelements[i]);
+
+		dst->nelements[i] += src->nelements[i];
+	}
+
+	PG_RETURN_POINTER(dst);
+}
+
+/*
+ * All the columns get serialized into a single bytea value, so together
+ * they have to fit into 1GB (see reserve_serialized). Each value needs at
+ * least one byte, so reserve that much right away - that rejects states
+ * that can't possibly fit before sorting any of the columns.
+ */
+Datum
+quantile_columns_serialize(PG_FUNCTION_ARGS)
+{
+	int				i;
+	int64			nvalues = 0;
+	quantile_columns_state *state;
+	StringInfoData	buf;
+
+	CHECK_AGG_CONTEXT("quantile_columns_serialize", fcinfo);
+
+	state = (quantile_columns_state *) PG_GETARG_POINTER(0);
+
+	for (i = 0; i < state->ncolumns; i++)
+		nvalues += state->nelements[i];
+
+	pq_begintypsend(&buf);
+
+	reserve_serialized(&buf, (Size) nvalues + state->ncolumns * sizeof(int32) +
+					   (state->nquantiles + 2) * sizeof(int64));
+
+	pq_sendint32(&buf, state->nquantiles);
+	for (i = 0; i < state->nquantiles; i++)
+		pq_sendfloat8(&buf, state->quantiles[i]);
+
+	pq_sendint32(&buf, state->ncolumns);
+
+	for (i = 0; i < state->ncolumns; i++)
+	{
+		quantile_sort(state->columns[i], state->nelements[i],
+					  QUANTILE_TYPE_DOUBLE);
+
+		pq_sendint32(&buf, state->nelements[i]);
+
+		send_sorted_values(&buf, QUANTILE_TYPE_DOUBLE,
+						   (char *) state->columns[i], state->nelements[i]);
+	}
+
+	PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+Datum
+quantile_columns_deserialize(PG_FUNCTION_ARGS)
+{
+	int				i;
+	bytea		   *sstate;
+	quantile_columns_state *state;
+	double		   *quantiles;
+	int				nquantiles;
+	StringInfoData	buf;
+	MemoryContext	aggcontext;
+	MemoryContext	oldcontext;
+
+	GET_AGG_CONTEXT("quantile_columns_deserialize", fcinfo, aggcontext);
+
+	sstate = PG_GETARG_BYTEA_PP(0);
+
+	initStringInfo(&buf);
+	appendBinaryStringInfo(&buf, VARDATA_ANY(sstate),
+						   VARSIZE_ANY_EXHDR(sstate));
+
+	oldcontext = MemoryContextSwitchTo(aggcontext);
+
+	nquantiles = pq_getmsgint(&buf, 4);
+	quantiles = (double *) palloc(sizeof(double) * nquantiles);
+	for (i = 0; i < nquantiles; i++)
+		quantiles[i] = pq_getmsgfloat8(&buf);
+
+	state = columns_state_create(pq_getmsgint(&buf, 4), nquantiles, quantiles);
+
+	for (i = 0; i < state->ncolumns; i++)
+	{
+		int		nvalues = pq_getmsgint(&buf, 4);
+
+		columns_grow(state, i, nvalues);
+
+		recv_sorted_values(&buf, QUANTILE_TYPE_DOUBLE,
+						   (char *) state->columns[i], nvalues);
+
+		state->nelements[i] = nvalues;
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+
+	pq_getmsgend(&buf);
+	pfree(buf.data);
+
+	PG_RETURN_POINTER(state);
+}
+
+/*
+ * Storable quantile sketches - quantile_sketch_agg() builds the same
+ * Greenwald-Khanna summary as quantile_eps (the transition and combine
+ * functions are shared), but returns it as a small varlena value (of type
+ * quantile_sketch_double etc.) that can be stored in a table, e.g. one
+ * sketch per range of heap blocks (see quantile_block_range), similar to
+ * the summaries kept by a BRIN index. The quantile_sketch_merge()
+ * aggregates then merge the sketches into a new sketch, or directly into
+ * approximate quantiles. Merging does not increase the relative error, so
+ * the rank of the result is within (epsilon * count) of the requested one,
+ * just like for quantile_eps.
+ */
+Datum
+quantile_sketch_final(PG_FUNCTION_ARGS)
+{
+	quantile_eps_state *state;
+
+	CHECK_AGG_CONTEXT("quantile_sketch_final", fcinfo);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	state = (quantile_eps_state *) PG_GETARG_POINTER(0);
+
+	PG_RETURN_BYTEA_P(sketch_encode(state));
+}
+
+/*
+ * Merge a stored sketch into the aggregate state. The variant returning
+ * quantiles gets the array of quantiles as the third argument (and uses
+ * the quantile_eps final functions).
+ */
+static Datum
+sketch_merge_append(FunctionCallInfo fcinfo, int type, const char *fname)
+{
+	quantile_eps_state *state;
+	quantile_eps_state *sketch;
+	bytea			   *stored;
+
+	MemoryContext	oldcontext;
+	MemoryContext	aggcontext;
+
+	/* OK, we do want to skip NULL sketches altogether */
+	if (PG_ARGISNULL(1))
+	{
+		if (PG_ARGISNULL(0))
+			PG_RETURN_NULL();
+		else
+			/* if there already is a state accumulated, don't forget it */
+			PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	}
+
+	GET_AGG_CONTEXT(fname, fcinfo, aggcontext);
+
+	/* detoast in the per-call context, only the merged summary is kept */
+	stored = PG_GETARG_BYTEA_PP(1);
+
+	if (PG_ARGISNULL(0))
+	{
+		oldcontext = MemoryContextSwitchTo(aggcontext);
+
+		/* the first sketch simply becomes the state */
+		state = sketch_decode(stored, type);
+
+		/* read the array of quantiles */
+		if (PG_NARGS() > 2)
+		{
+			if (PG_ARGISNULL(2))
+				elog(ERROR, "quantiles must not be NULL");
+
+			state->quantiles = array_to_double(fcinfo, PG_GETARG_ARRAYTYPE_P(2),
+											   &state->nquantiles);
+
+			check_quantiles(state->nquantiles, state->quantiles);
+		}
+	}
+	else
+	{
+		quantile_eps_state *prev = (quantile_eps_state *) PG_GETARG_POINTER(0);
+
+		sketch = sketch_decode(stored, type);
+
+		oldcontext = MemoryContextSwitchTo(aggcontext);
+
+		/* the merged summary is a new copy, so free the original ones */
+		state = eps_state_merge(prev, sketch);
+
+		eps_state_free(prev);
+		eps_state_free(sketch);
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+
+	PG_FREE_IF_COPY(stored, 1);
+
+	PG_RETURN_POINTER(state);
+}
+
+Datum
+quantile_sketch_merge_append_double(PG_FUNCTION_ARGS)
+{
+	return sketch_merge_append(fcinfo, QUANTILE_TYPE_DOUBLE,
+							   "quantile_sketch_merge_append_double");
+}
+
+Datum
+quantile_sketch_merge_append_int32(PG_FUNCTION_ARGS)
+{
+	return sketch_merge_append(fcinfo, QUANTILE_TYPE_INT32,
+							   "quantile_sketch_merge_append_int32");
+}
+
+Datum
+quantile_sketch_merge_append_int64(PG_FUNCTION_ARGS)
+{
+	return sketch_merge_append(fcinfo, QUANTILE_TYPE_INT64,
+							   "quantile_sketch_merge_append_int64");
+}
+
+Datum
+quantile_sketch_merge_append_numeric(PG_FUNCTION_ARGS)
+{
+	return sketch_merge_append(fcinfo, QUANTILE_TYPE_NUMERIC,
+							   "quantile_sketch_merge_append_numeric");
+}
+
+/*
+ * Merge two sketches into a new one, e.g. to add a sketch of newly
+ * inserted rows to the stored sketch of a block range. A NULL sketch
+ * is treated as empty.
+ */
+static Datum
+sketch_combine(FunctionCallInfo fcinfo, int type)
+{
+	quantile_eps_state *a;
+	quantile_eps_state *b;
+
+	if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
+		PG_RETURN_NULL();
+
+	a = PG_ARGISNULL(0) ? NULL : sketch_decode(PG_GETARG_BYTEA_PP(0), type);
+	b = PG_ARGISNULL(1) ? NULL : sketch_decode(PG_GETARG_BYTEA_PP(1), type);
+
+	PG_RETURN_BYTEA_P(sketch_encode(eps_state_merge(a, b)));
+}
+
+Datum
+quantile_sketch_combine_double(PG_FUNCTION_ARGS)
+{
+	return sketch_combine(fcinfo, QUANTILE_TYPE_DOUBLE);
+}
+
+Datum
+quantile_sketch_combine_int32(PG_FUNCTION_ARGS)
+{
+	return sketch_combine(fcinfo, QUANTILE_TYPE_INT32);
+}
+
+Datum
+quantile_sketch_combine_int64(PG_FUNCTION_ARGS)
+{
+	return sketch_combine(fcinfo, QUANTILE_TYPE_INT64);
+}
+
+Datum
+quantile_sketch_combine_numeric(PG_FUNCTION_ARGS)
+{
+	return sketch_combine(fcinfo, QUANTILE_TYPE_NUMERIC);
+}
+
+/*
+ * Number of the range of heap blocks containing the tuple (with the given
+ * number of blocks per range), to build a sketch for each range.
+ */
+Datum
+quantile_block_range(PG_FUNCTION_ARGS)
+{
+	ItemPointer	tid = PG_GETARG_ITEMPOINTER(0);
+	int32		pages_per_range = PG_GETARG_INT32(1);
+
+	if (pages_per_range < 1)
+		elog(ERROR, "invalid number of pages per range %d", pages_per_range);
+
+	PG_RETURN_INT64(ItemPointerGetBlockNumber(tid) / pages_per_range);
+}
+
+/*
+ * Robust statistics - median, interquartile range, median absolute
+ * deviation and a trimmed mean, computed together from a single state.
+ * Computing the MAD in SQL needs a second aggregate over abs(x - median),
+ * i.e. a subquery collecting and sorting all the values again. Here we
+ * sort the values once (or merge the sorted runs / use the stored state),
+ * and the rest is computed from the sorted array - the deviations below
+ * and above the median are both sorted (in opposite directions), so the
+ * median deviation is found by merging the two halves, without sorting.
+ *
+ * The median and quartiles use the same definition as quantile(), i.e.
+ * there's no interpolation. All the results are double precision.
+ */
+static Datum
+robust_stats(FunctionCallInfo fcinfo, char *values, int nvalues, int type)
+{
+	int			i,
+				j,
+				k;
+	int			mid;
+	int			ntrim;
+	double	   *v;
+	double		median;
+	double		mad = 0;
+	double		sum = 0;
+	TupleDesc	tupdesc;
+	Datum		result[4];
+	bool		nulls[4] = {false, false, false, false};
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	v = values_to_double(values, nvalues, type);
+
+	mid = (int) ceil(nvalues * 0.5) - 1;
+	median = v[mid];
+
+	/*
+	 * Deviations of values up to the median grow when walking down from
+	 * the median (i), the deviations of the values above it grow when
+	 * walking up (j). Merge the two sequences until reaching the median
+	 * deviation (with the same index as the median).
+	 */
+	i = mid;
+	j = mid + 1;
+	for (k = 0; k <= mid; k++)
+	{
+		if ((j == nvalues) || ((i >= 0) && (median - v[i] <= v[j] - median)))
+			mad = median - v[i--];
+		else
+			mad = v[j++] - median;
+	}
+
+	/* trimmed mean, without the same number of values at each end */
+	ntrim = (int) floor(nvalues * QUANTILE_TRIM_FRACTION);
+	for (i = ntrim; i < nvalues - ntrim; i++)
+		sum += v[i];
+
+	result[0] = Float8GetDatum(median);
+	result[1] = Float8GetDatum(v[(int) ceil(nvalues * 0.75) - 1] -
+							   v[(int) ceil(nvalues * 0.25) - 1]);
+	result[2] = Float8GetDatum(mad);
+	result[3] = Float8GetDatum(sum / (nvalues - 2 * ntrim));
+
+	if (v != (double *) values)
+		pfree(v);
+
+	tupdesc = BlessTupleDesc(tupdesc);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, result, nulls)));
+}
+
+static Datum
+robust_stats_final(FunctionCallInfo fcinfo, int type)
+{
+	quantile_state *state;
+	char		   *values;
+	int				nvalues;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	state = (quantile_state *) PG_GETARG_POINTER(0);
+
+	/* merge the runs from parallel workers (or just sort the values) */
+	values = state_sorted_values(state, type, &nvalues);
+
+	return robust_stats(fcinfo, values, nvalues, type);
+}
+
+Datum
+quantile_robust_stats_double(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("quantile_robust_stats_double", fcinfo);
+
+	return robust_stats_final(fcinfo, QUANTILE_TYPE_DOUBLE);
+}
+
+Datum
+quantile_robust_stats_int32(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("quantile_robust_stats_int32", fcinfo);
+
+	return robust_stats_final(fcinfo, QUANTILE_TYPE_INT32);
+}
+
+Datum
+quantile_robust_stats_int64(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("quantile_robust_stats_int64", fcinfo);
+
+	return robust_stats_final(fcinfo, QUANTILE_TYPE_INT64);
+}
+
+Datum
+quantile_robust_stats_numeric(PG_FUNCTION_ARGS)
+{
+	CHECK_AGG_CONTEXT("quantile_robust_stats_numeric", fcinfo);
+
+	return robust_stats_final(fcinfo, QUANTILE_TYPE_NUMERIC);
+}
+
+/* the stored states are already sorted */
+static Datum
+stored_state_robust_stats(FunctionCallInfo fcinfo, int type)
+{
+	char	   *values;
+	int			nvalues;
+
+	values = stored_state_decode(PG_GETARG_BYTEA_PP(0), type, &nvalues);
+
+	if (nvalues == 0)
+		PG_RETURN_NULL();
+
+	return robust_stats(fcinfo, values, nvalues, type);
+}
+
+Datum
+quantile_state_robust_stats_double(PG_FUNCTION_ARGS)
+{
+	return stored_state_robust_stats(fcinfo, QUANTILE_TYPE_DOUBLE);
+}
+
+Datum
+quantile_state_robust_stats_int32(PG_FUNCTION_ARGS)
+{
+	return stored_state_robust_stats(fcinfo, QUANTILE_TYPE_INT32);
+}
+
+Datum
+quantile_state_robust_stats_int64(PG_FUNCTION_ARGS)
+{
+	return stored_state_robust_stats(fcinfo, QUANTILE_TYPE_INT64);
+}
+
+Datum
+quantile_state_robust_stats_numeric(PG_FUNCTION_ARGS)
+{
+	return stored_state_robust_stats(fcinfo, QUANTILE_TYPE_NUMERIC);
+}
+
+/* Comparators for the qsort() calls. */
+
+/* NaN is equal to NaN and greater than any other value (like float8_cmp) */
+static int
+double_comparator(const void *a, const void *b)
+{
+	double af = (* (double*) a);
+	double bf = (* (double*) b);
+
+	if (isnan(af))
+		return isnan(bf) ? 0 : 1;
+	else if (isnan(bf))
+		return -1;
+
+	return (af > bf) - (af < bf);
+}
+
+static int
+int32_comparator(const void *a, const void *b)
+{
+	int32 af = (* (int32 *) a);
+	int32 bf = (* (int32 *) b);
+	return (af > bf) - (af < bf);
+}
+
+static int
+int64_comparator(const void *a, const void *b)
+{
+	int64 af = (* (int64 *) a);
+	int64 bf = (* (int64 *) b);
+	return (af > bf) - (af < bf);
+}
+
+static int
+numeric_comparator(const void *a, const void *b)
+{
+	Numeric	na = (* (Numeric *) a);
+	Numeric	nb = (* (Numeric *) b);
+
+	return DatumGetInt32(DirectFunctionCall2(numeric_cmp,
+											 NumericGetDatum(na),
+											 NumericGetDatum(nb)));
+}
+
+static int
+uint32_comparator(const void *a, const void *b)
+{
+	uint32 af = (* (uint32 *) a);
+	uint32 bf = (* (uint32 *) b);
+	return (af > bf) - (af < bf);
+}
+
+static int
+uint64_comparator(const void *a, const void *b)
+{
+	uint64 af = (* (uint64 *) a);
+	uint64 bf = (* (uint64 *) b);
+	return (af > bf) - (af < bf);
+}
+
+/*
+ * Reading quantiles from an input array, based mostly on
+ * array_to_text_internal (it's a modified copy). This expects
+ * to receive a single-dimensional float8 array as input, fails
+ * otherwise.
+ */
+static double *
+array_to_double(FunctionCallInfo fcinfo, ArrayType *array, int *arraylen)
+{
+	int			i;
+	Datum	   *keys;
+	int			nkeys;
+
+	/* info for deconstructing the array */
+	Oid			element_type;
+	int			typlen;
+	bool		typbyval;
+	char		typalign;
+
+	ArrayMetaState *my_extra;
+
+	/* result */
+	double	   *result;
+
+	element_type = ARR_ELEMTYPE(array);
+
+	if (element_type != FLOAT8OID)
+		elog(ERROR, "array expected to be double precision[]");
+
+	/*
+	 * We arrange to look up info about element type, including its output
+	 * conversion proc, only once per series of calls, assuming the element
+	 * type doesn't change underneath us.
+	 */
+	my_extra = (ArrayMetaState *) fcinfo->flinfo->fn_extra;
+	if (my_extra == NULL)
+	{
+		fcinfo->flinfo->fn_extra = MemoryContextAlloc(fcinfo->flinfo->fn_mcxt,
+													  sizeof(ArrayMetaState));
+		my_extra = (ArrayMetaState *) fcinfo->flinfo->fn_extra;
+		my_extra->element_type = ~element_type;
+	}
+
+	/*
+	 * Get info about element type, including its output conversion proc, if
+	 * we haven't done that already.
+	 */
+	if (my_extra->element_type != element_type)
+	{
+		get_type_io_data(element_type, IOFunc_output,
+						 &my_extra->typlen, &my_extra->typbyval,
+						 &my_extra->typalign, &my_extra->typdelim,
+						 &my_extra->typioparam, &my_extra->typiofunc);
+		fmgr_info_cxt(my_extra->typiofunc, &my_extra->proc,
+					  fcinfo->flinfo->fn_mcxt);
+		my_extra->element_type = element_type;
+	}
+
+	typlen = my_extra->typlen;
+	typbyval = my_extra->typbyval;
+	typalign = my_extra->typalign;
+
+	/* Extract data from array of int16 */
+	deconstruct_array(array, FLOAT8OID, typlen, typbyval, typalign,
+					  &keys, NULL, &nkeys);
+
+	result = (double *) palloc(sizeof(double) * nkeys);
+
+	for (i = 0; i < nkeys; i++)
+		result[i] = DatumGetFloat8(keys[i]);
+
+	*arraylen = nkeys;
+
+	return result;
+}
+
+/*
+ * Helper functions used to prepare the resulting array (when there's
+ * an array of quantiles).
+ */
+static Datum
+double_to_array(FunctionCallInfo fcinfo, double * d, int len)
+{
+	ArrayBuildState *astate = NULL;
+	int		 i;
+
+	for (i = 0; i < len; i++)
+	{
+		/* stash away this field */
+		astate = accumArrayResult(astate,
+								  Float8GetDatum(d[i]),
+								  false,
+								  FLOAT8OID,
+								  CurrentMemoryContext);
+	}
+
+	PG_RETURN_DATUM(makeArrayResult(astate,
+									CurrentMemoryContext));
+}
+
+static Datum
+int32_to_array(FunctionCallInfo fcinfo, int32 * d, int len)
+{
+	ArrayBuildState *astate = NULL;
+	int		 i;
+
+	for (i = 0; i < len; i++)
+	{
+		/* stash away this field */
+		astate = accumArrayResult(astate,
+								  Int32GetDatum(d[i]),
+								  false,
+								  INT4OID,
+								  CurrentMemoryContext);
+	}
+
+	PG_RETURN_DATUM(makeArrayResult(astate,
+									CurrentMemoryContext));
+}
+
+static Datum
+int64_to_array(FunctionCallInfo fcinfo, int64 * d, int len)
+{
+
+	ArrayBuildState *astate = NULL;
+	int		 i;
+
+	for (i = 0; i < len; i++)
+	{
+		/* stash away this field */
+		astate = accumArrayResult(astate,
+								  Int64GetDatum(d[i]),
+								  false,
+								  INT8OID,
+								  CurrentMemoryContext);
+	}
+
+	PG_RETURN_DATUM(makeArrayResult(astate,
+									CurrentMemoryContext));
+}
+
+static Datum
+numeric_to_array(FunctionCallInfo fcinfo, Numeric * d, int len)
+{
+	ArrayBuildState *astate = NULL;
+	int		 i;
+
+	for (i = 0; i < len; i++)
+	{
+		/* stash away this field */
+		astate = accumArrayResult(astate,
+								  NumericGetDatum(d[i]),
+								  false,
+								  NUMERICOID,
+								  CurrentMemoryContext);
+	}
+
+	PG_RETURN_DATUM(makeArrayResult(astate,
+									CurrentMemoryContext));
+}
+
+static void
+check_quantiles(int nquantiles, double * quantiles)
+{
+	int i = 0;
+	for (i = 0; i < nquantiles; i++)
+		if (quantiles[i] < 0 || quantiles[i] > 1)
+			elog(ERROR, "invalid percentile value %f - needs to be in [0,1]", quantiles[i]);
+}
+
+/*
+ * Is the transition function called by a parallel worker (or some other
+ * partial aggregation), i.e. is the state going to be serialized?
+ */
+static bool
+partial_aggregate(FunctionCallInfo fcinfo)
+{
+#if (PG_VERSION_NUM >= 90600)
+	if (fcinfo->context && IsA(fcinfo->context, AggState))
+		return DO_AGGSPLIT_SERIALIZE(((AggState *) fcinfo->context)->aggsplit);
+#endif
+
+	return false;
+}
+
+/*
+ * Make room for another value in an int64/double state - either by
+ * enlarging the elements array, or (when that would exceed the limit
+ * set by quantile.spill_mem) by spilling the values to a file. Without
+ * the limit, full blocks of values get sorted into runs instead.
+ *
+ * Partial states are never spilled, as the values would have to be read
+ * back into memory to pass them to the leader anyway. The leader spills
+ * the combined runs instead (see state_combine).
+ */
+static void
+quantile_make_room(quantile_state *state, bool isdouble)
+{
+	MemoryContext	oldcontext;
+
+	Assert(state->nelements == state->maxelements);
+
+	/* the runs are not spilled, so keep building them once we have some */
+	if ((state->spill == NULL) &&
+		((quantile_spill_mem == 0) || (state->nruns > 0) || state->partial))
+	{
+		state_sort_block(state, isdouble ? QUANTILE_TYPE_DOUBLE : QUANTILE_TYPE_INT64);
+		return;
+	}
+
+	/* the elements array may use half of the limit (see quantile_spill) */
+	if ((state->spill == NULL) &&
+		((Size) state->maxelements * 2 * sizeof(int64) <=
+		 (Size) quantile_spill_mem * 1024L / 2))
+	{
+		state_grow(state, sizeof(int64), state->nelements + 1);
+		return;
+	}
+
+	/* the spill file needs to live in the aggregate context */
+	oldcontext = MemoryContextSwitchTo(state->aggcontext);
+
+	spill_elements(state, isdouble);
+
+	MemoryContextSwitchTo(oldcontext);
+}
+
+static void
+spill_write(BufFile *file, void *data, Size len)
+{
+#if (PG_VERSION_NUM >= 160000)
+	BufFileWrite(file, data, len);
+#else
+	if (BufFileWrite(file, data, len) != len)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write to quantile temporary file: %m")));
+#endif
+}
+
+static void
+spill_read(BufFile *file, void *data, Size len)
+{
+#if (PG_VERSION_NUM >= 160000)
+	BufFileReadExact(file, data, len);
+#else
+	if (BufFileRead(file, data, len) != len)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read from quantile temporary file: %m")));
+#endif
+}
+
+static void
+spill_seek(quantile_spill *spill, int64 nkeys)
+{
+	/* BufFileSeek moves to the right segment for offsets past 1GB */
+	if (BufFileSeek(spill->file, 0, (off_t) (nkeys * sizeof(uint64)),
+					SEEK_SET) != 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not seek in quantile temporary file: %m")));
+}
+
+/*
+ * Convert the values accumulated in the elements array to keys, write
+ * them to the spill file (creating it if needed) and update the counts
+ * of the top-level buckets. The elements array is empty afterwards.
+ */
+static void
+spill_elements(quantile_state *state, bool isdouble)
+{
+	spill_keys(state, isdouble, (uint64 *) state->elements, state->nelements);
+
+	state->nelements = 0;
+}
+
+/*
+ * Write all the sorted runs (collected by the combine function) to the
+ * spill file, and free them.
+ */
+static void
+spill_runs(quantile_state *state, bool isdouble)
+{
+	int		i;
+
+	for (i = 0; i < state->nruns; i++)
+	{
+		spill_keys(state, isdouble, (uint64 *) state->runs[i].elements,
+				   state->runs[i].nelements);
+
+		pfree(state->runs[i].elements);
+	}
+
+	state->nruns = 0;
+}
+
+/*
+ * Copy values spilled by another state into the spill file of this state
+ * (creating it if needed), and close the other spill file.
+ */
+static void
+spill_copy(quantile_state *state, quantile_state *src, bool isdouble)
+{
+	int		i;
+	int64	nread;
+	uint64 *keys = (uint64 *) palloc(QUANTILE_SPILL_CHUNK * sizeof(uint64));
+
+	spill_seek(src->spill, 0);
+
+	for (nread = 0; nread < src->spill->nkeys; nread += QUANTILE_SPILL_CHUNK)
+	{
+		int		n = (int) Min(QUANTILE_SPILL_CHUNK, src->spill->nkeys - nread);
+
+		spill_read(src->spill->file, keys, n * sizeof(uint64));
+
+		/* spill_keys expects the values, so convert the keys back */
+		for (i = 0; i < n; i++)
+		{
+			if (isdouble)
+			{
+				double	value = key_to_double(keys[i]);
+
+				memcpy(&keys[i], &value, sizeof(double));
+			}
+			else
+				keys[i] = (uint64) key_to_int64(keys[i]);
+		}
+
+		spill_keys(state, isdouble, keys, n);
+	}
+
+	pfree(keys);
+
+	BufFileClose(src->spill->file);
+	pfree(src->spill->counts);
+	pfree(src->spill);
+	src->spill = NULL;
+}
+
+/*
+ * Convert int64/double values to keys (in place), write them to the spill
+ * file and count them in the top-level buckets.
+ */
+static void
+spill_keys(quantile_state *state, bool isdouble, uint64 *keys, int nkeys)
+{
+	int				i;
+	quantile_spill *spill = state->spill;
+
+	if (spill == NULL)
+	{
+		/* the counts get a sixth of the limit (at least the minimum) */
+		Size	limit = (Size) quantile_spill_mem * 1024L / 6;
+
+		spill = (quantile_spill *) palloc0(sizeof(quantile_spill));
+		spill->file = BufFileCreateTemp(false);
+
+		spill->nbits = QUANTILE_SPILL_MIN_BITS;
+		while ((spill->nbits < QUANTILE_SPILL_MAX_BITS) &&
+			   (((Size) 1 << (spill->nbits + 1)) * sizeof(int64) <= limit))
+			spill->nbits++;
+
+		spill->counts = (int64 *) palloc0(sizeof(int64) << spill->nbits);
+
+		state->spill = spill;
+	}
+
+	/* convert the values in place (both types are 8 bytes) */
+	for (i = 0; i < nkeys; i++)
+	{
+		if (isdouble)
+		{
+			double	value;
+
+			memcpy(&value, &keys[i], sizeof(double));
+			keys[i] = double_to_key(value);
+		}
+		else
+			keys[i] = int64_to_key((int64) keys[i]);
+
+		spill->counts[keys[i] >> (64 - spill->nbits)]++;
+	}
+
+	/* the final function may have moved the position, so always seek */
+	spill_seek(spill, spill->nkeys);
+	spill_write(spill->file, keys, (Size) nkeys * sizeof(uint64));
+
+	spill->nkeys += nkeys;
+}
+
+/*
+ * Find the key at the requested quantile in the spilled data. We start
+ * with the top-level bucket counts collected while spilling, and locate
+ * the bucket containing the rank. If the bucket is small enough to fit
+ * into the elements array, we re-read the file, collect the keys from
+ * the bucket and sort them. Otherwise we re-read the file and count the
+ * keys in the bucket using the next nbits bits, and repeat. So the memory
+ * needed is proportional to the bucket, not all the data, and the counts
+ * and the read buffer are sized from quantile.spill_mem.
+ */
+static uint64
+spill_quantile(quantile_state *state, double quantile, bool isdouble)
+{
+	quantile_spill *spill;
+	int64		   *counts;
+	int64		   *refined = NULL;
+	uint64		   *chunk;
+	int				nchunk;
+	int64			maxkeys;
+	uint64		   *keys = (uint64 *) state->elements;
+	int64			rank = 0;
+	uint64			prefix = 0;
+	int				nbits = 0;
+	int				step;
+
+	/* make sure all the values are in the file */
+	if (state->nelements > 0)
+		spill_elements(state, isdouble);
+
+	spill = state->spill;
+	counts = spill->counts;
+	step = spill->nbits;
+
+	if (quantile > 0)
+		rank = (int64) ceil(spill->nkeys * quantile) - 1;
+
+	/*
+	 * The keys of a bucket get collected once they fit into half of the
+	 * limit (the memory quantile_make_room allows for the elements array),
+	 * and the read buffer gets a sixth (just like the counts). The state
+	 * may come from the combine function, with a tiny elements array.
+	 */
+	maxkeys = Max(state->maxelements,
+				  (int64) quantile_spill_mem * 1024L / 2 / sizeof(uint64));
+
+	nchunk = Max(QUANTILE_SPILL_CHUNK,
+				 (int64) quantile_spill_mem * 1024L / 6 / sizeof(uint64));
+	chunk = (uint64 *) palloc(nchunk * sizeof(uint64));
+
+	while (true)
+	{
+		int		i;
+		int		bucket;
+		int64	nread;
+
+		/* find the bucket with the rank, make the rank relative to it */
+		for (bucket = 0; bucket < (1 << step); bucket++)
+		{
+			if (rank < counts[bucket])
+				break;
+
+			rank -= counts[bucket];
+		}
+
+		Assert(bucket < (1 << step));
+
+		prefix = (prefix << step) | bucket;
+		nbits += step;
+
+		/* all bits are known, so all keys in the bucket are equal */
+		if (nbits == 64)
+			break;
+
+		spill_seek(spill, 0);
+
+		/* small enough bucket, so just collect the keys and sort them */
+		if (counts[bucket] <= maxkeys)
+		{
+			int64	nkeys = 0;
+
+			if (counts[bucket] > state->maxelements)
+				keys = (uint64 *) MemoryContextAllocHuge(CurrentMemoryContext,
+														 counts[bucket] * sizeof(uint64));
+
+			for (nread = 0; nread < spill->nkeys; nread += nchunk)
+			{
+				int	n = Min(nchunk, spill->nkeys - nread);
+
+				spill_read(spill->file, chunk, n * sizeof(uint64));
+
+				for (i = 0; i < n; i++)
+					if ((chunk[i] >> (64 - nbits)) == prefix)
+						keys[nkeys++] = chunk[i];
+			}
+
+			Assert(nkeys == counts[bucket]);
+
+			qsort(keys, nkeys, sizeof(uint64), &uint64_comparator);
+
+			prefix = keys[rank];
+
+			if (keys != (uint64 *) state->elements)
+				pfree(keys);
+
+			break;
+		}
+
+		/* too many keys, so refine the bucket using the next bits */
+		step = Min(spill->nbits, 64 - nbits);
+
+		if (refined == NULL)
+			refined = (int64 *) palloc(sizeof(int64) << spill->nbits);
+
+		memset(refined, 0, sizeof(int64) << step);
+
+		for (nread = 0; nread < spill->nkeys; nread += nchunk)
+		{
+			int	n = Min(nchunk, spill->nkeys - nread);
+
+			spill_read(spill->file, chunk, n * sizeof(uint64));
+
+			for (i = 0; i < n; i++)
+				if ((chunk[i] >> (64 - nbits)) == prefix)
+					refined[(chunk[i] >> (64 - nbits - step))
+							& (((uint64) 1 << step) - 1)]++;
+		}
+
+		counts = refined;
+	}
+
+	pfree(chunk);
+
+	if (refined)
+		pfree(refined);
+
+	return prefix;
+}
+
+static Size
+quantile_type_size(int type)
+{
+	switch (type)
+	{
+		case QUANTILE_TYPE_INT32:
+			return sizeof(int32);
+		case QUANTILE_TYPE_INT64:
+			return sizeof(int64);
+		case QUANTILE_TYPE_DOUBLE:
+			return sizeof(double);
+		case QUANTILE_TYPE_NUMERIC:
+			return sizeof(Numeric);
+	}
+
+	elog(ERROR, "unknown quantile data type %d", type);
+	return 0;	/* keep compiler quiet */
+}
+
+static int
+(*quantile_type_comparator(int type)) (const void *a, const void *b)
+{
+	switch (type)
+	{
+		case QUANTILE_TYPE_INT32:
+			return int32_comparator;
+		case QUANTILE_TYPE_INT64:
+			return int64_comparator;
+		case QUANTILE_TYPE_DOUBLE:
+			return double_comparator;
+		case QUANTILE_TYPE_NUMERIC:
+			return numeric_comparator;
+	}
+
+	elog(ERROR, "unknown quantile data type %d", type);
+	return NULL;	/* keep compiler quiet */
+}
+
+/*
+ * Sort an array of values of the given type. The int32/int64/double values
+ * are sorted as order-preserving uint32/uint64 keys (converted in place,
+ * int32 values get 32-bit keys), which is cheaper than
+ * comparing the values and gives a total order with NaN sorted after all
+ * other values, the same as in PostgreSQL. The only difference is that
+ * -0.0 sorts before 0.0, which are equal for double_comparator.
+ *
+ * A single pass over the keys determines the range of keys and whether
+ * they are already sorted, and that decides the algorithm (unless forced
+ * by quantile.sort_method):
+ *
+ * - sorted keys are left alone (e.g. values passed in ORDER BY order)
+ * - counting sort, for a small range of keys (fewer distinct keys than
+ *   values, and the counts fit into CPU cache)
+ * - LSD radix sort, for larger arrays (but not with quantile.spill_mem,
+ *   as it needs a temporary copy of the keys)
+ * - qsort otherwise
+ *
+ * The algorithm actually used is reported at DEBUG1 level.
+ */
+static void
+quantile_sort(void *elements, int nelements, int type)
+{
+	uint64	min,
+			max;
+	bool	sorted;
+	bool	wide = (type != QUANTILE_TYPE_INT32);
+	int		method = quantile_sort_method;
+	const char *algorithm;
+
+	if (nelements < 2)
+		return;
+
+	if (type == QUANTILE_TYPE_NUMERIC)
+	{
+		qsort(elements, nelements, sizeof(Numeric), &numeric_comparator);
+		elog(DEBUG1, "sorted %d values using qsort", nelements);
+		return;
+	}
+
+	elements_to_keys(elements, nelements, type);
+
+	sorted = keys_range(elements, nelements, wide, &min, &max);
+
+	/* selection only matters for quantile_select */
+	if (method == QUANTILE_SORT_SELECT)
+		method = QUANTILE_SORT_AUTO;
+
+	if (sorted && (method == QUANTILE_SORT_AUTO))
+		algorithm = NULL;
+	else if ((max - min < QUANTILE_COUNTING_RANGE) &&
+			 ((method == QUANTILE_SORT_COUNTING) ||
+			  ((method == QUANTILE_SORT_AUTO) && (max - min < nelements))))
+	{
+		counting_sort_keys(elements, nelements, wide, min, max);
+		algorithm = "counting sort";
+	}
+	else if ((method == QUANTILE_SORT_RADIX) ||
+			 ((method == QUANTILE_SORT_AUTO) && (quantile_spill_mem == 0) &&
+			  (nelements >= QUANTILE_RADIX_MIN)))
+	{
+		radix_sort_keys(elements, nelements, wide, min, max);
+		algorithm = "radix sort";
+	}
+	else
+	{
+		if (wide)
+			qsort(elements, nelements, sizeof(uint64), &uint64_comparator);
+		else
+			qsort(elements, nelements, sizeof(uint32), &uint32_comparator);
+		algorithm = "qsort";
+	}
+
+	keys_to_elements(elements, nelements, type);
+
+	if (algorithm == NULL)
+		elog(DEBUG1, "%d values already sorted", nelements);
+	else
+		elog(DEBUG1, "sorted %d values using %s", nelements, algorithm);
+}
+
+/*
+ * Select a single quantile from an array of values, without sorting all
+ * of them. The values get reordered. Extreme quantiles are selected using
+ * a small heap (see tail_select), other int32/int64/double quantiles using
+ * introselect on the keys. Returns false if the values should be sorted
+ * instead (numeric quantiles that are not extreme, or when a sort
+ * algorithm is forced by quantile.sort_method).
+ */
+static bool
+quantile_select(void *elements, int nelements, int type, double quantile,
+				char *result)
+{
+	int		idx = 0;
+	uint64	key;
+
+	if ((quantile_sort_method != QUANTILE_SORT_AUTO) &&
+		(quantile_sort_method != QUANTILE_SORT_SELECT))
+		return false;
+
+	if ((quantile_sort_method == QUANTILE_SORT_AUTO) &&
+		tail_select(elements, nelements, type, quantile, result))
+		return true;
+
+	if (type == QUANTILE_TYPE_NUMERIC)
+		return false;
+
+	if (quantile > 0)
+		idx = (int) ceil(nelements * quantile) - 1;
+
+	elements_to_keys(elements, nelements, type);
+
+	key = select_key(elements, nelements, (type != QUANTILE_TYPE_INT32), idx);
+
+	keys_to_elements(elements, nelements, type);
+
+	switch (type)
+	{
+		case QUANTILE_TYPE_INT32:
+			*(int32 *) result = key_to_int32((uint32) key);
+			break;
+
+		case QUANTILE_TYPE_INT64:
+			*(int64 *) result = key_to_int64(key);
+			break;
+
+		case QUANTILE_TYPE_DOUBLE:
+			*(double *) result = key_to_double(key);
+			break;
+	}
+
+	return true;
+}
+
+/*
+ * Read an array of values of the given type (e.g. rank thresholds) into
+ * a plain C array, in the current memory context. NULLs are not allowed.
+ */
+static void *
+array_to_elements(ArrayType *array, int type, int *len)
+{
+	int			i;
+	Datum	   *keys;
+	bool	   *nulls;
+	int			nkeys;
+	Size		elsize = quantile_type_size(type);
+	char	   *result;
+	Oid			element_type;
+	int16		typlen;
+	bool		typbyval;
+	char		typalign;
+
+	switch (type)
+	{
+		case QUANTILE_TYPE_INT32:
+			element_type = INT4OID;
+			break;
+		case QUANTILE_TYPE_INT64:
+			element_type = INT8OID;
+			break;
+		case QUANTILE_TYPE_DOUBLE:
+			element_type = FLOAT8OID;
+			break;
+		default:
+			element_type = NUMERICOID;
+			break;
+	}
+
+	if (ARR_ELEMTYPE(array) != element_type)
+		elog(ERROR, "array has unexpected element type %u", ARR_ELEMTYPE(array));
+
+	get_typlenbyvalalign(element_type, &typlen, &typbyval, &typalign);
+
+	deconstruct_array(array, element_type, typlen, typbyval, typalign,
+					  &keys, &nulls, &nkeys);
+
+	result = palloc(elsize * Max(nkeys, 1));
+
+	for (i = 0; i < nkeys; i++)
+	{
+		if (nulls[i])
+			elog(ERROR, "array must not contain NULL values");
+
+		switch (type)
+		{
+			case QUANTILE_TYPE_INT32:
+				((int32 *) result)[i] = DatumGetInt32(keys[i]);
+				break;
+
+			case QUANTILE_TYPE_INT64:
+				((int64 *) result)[i] = DatumGetInt64(keys[i]);
+				break;
+
+			case QUANTILE_TYPE_DOUBLE:
+				((double *) result)[i] = DatumGetFloat8(keys[i]);
+				break;
+
+			case QUANTILE_TYPE_NUMERIC:
+			{
+				Numeric	num = DatumGetNumeric(keys[i]);
+				Numeric	value = (Numeric) palloc(VARSIZE(num));
+
+				memcpy(value, num, VARSIZE(num));
+				((Numeric *) result)[i] = value;
+				break;
+			}
+		}
+	}
+
+	*len = nkeys;
+
+	return result;
+}
+
+static Datum
+elements_to_array(FunctionCallInfo fcinfo, int type, void *elements, int len)
+{
+	switch (type)
+	{
+		case QUANTILE_TYPE_INT32:
+			return int32_to_array(fcinfo, (int32 *) elements, len);
+		case QUANTILE_TYPE_INT64:
+			return int64_to_array(fcinfo, (int64 *) elements, len);
+		case QUANTILE_TYPE_DOUBLE:
+			return double_to_array(fcinfo, (double *) elements, len);
+		case QUANTILE_TYPE_NUMERIC:
+			return numeric_to_array(fcinfo, (Numeric *) elements, len);
+	}
+
+	elog(ERROR, "unknown quantile data type %d", type);
+	return (Datum) 0;	/* keep compiler quiet */
+}
+
+/*
+ * Enlarge the elements array so that it can hold at least nelements
+ * values (doubling the size). We use the "huge" allocations, so the
+ * array is not limited to MaxAllocSize (1GB), only the number of values
+ * is limited to INT_MAX. Such large chunks are allocated by malloc()
+ * directly, so growing them usually just remaps the memory (e.g. glibc
+ * realloc uses mremap) instead of copying it.
+ */
+static void
+state_grow(quantile_state *state, Size elsize, int64 nelements)
+{
+	int64	maxelements = state->maxelements;
+
+	while (maxelements < nelements)
+		maxelements *= 2;
+
+	maxelements = Min(maxelements, INT_MAX);
+
+	if ((Size) maxelements > MaxAllocHugeSize / elsize)
+		maxelements = MaxAllocHugeSize / elsize;
+
+	if (maxelements < nelements)
+		elog(ERROR, "too many values in the quantile state");
+
+	state->elements = repalloc_huge(state->elements, elsize * maxelements);
+	state->maxelements = (int) maxelements;
+}
+
+/*
+ * Append a value (passed as a Datum) to the state, enlarging the array
+ * if needed. Numeric values are copied into the current memory context,
+ * which is expected to be the aggregate context.
+ */
+static void
+state_append_datum(quantile_state *state, int type, Datum value)
+{
+	if (state->nelements == state->maxelements)
+		state_grow(state, quantile_type_size(type), state->nelements + 1);
+
+	state_set_datum(state, type, state->nelements, value);
+
+	state->nelements++;
+}
+
+/*
+ * Store a value (passed as a Datum) at the given position of the elements
+ * array. Numeric values are copied into the current memory context.
+ */
+static void
+state_set_datum(quantile_state *state, int type, int idx, Datum value)
+{
+	char   *element = (char *) state->elements + idx * quantile_type_size(type);
+
+	switch (type)
+	{
+		case QUANTILE_TYPE_INT32:
+			*(int32 *) element = DatumGetInt32(value);
+			break;
+
+		case QUANTILE_TYPE_INT64:
+			*(int64 *) element = DatumGetInt64(value);
+			break;
+
+		case QUANTILE_TYPE_DOUBLE:
+			*(double *) element = DatumGetFloat8(value);
+			break;
+
+		case QUANTILE_TYPE_NUMERIC:
+		{
+			Numeric	num = DatumGetNumeric(value);
+			Numeric	copy = (Numeric) MemoryContextAlloc(state->aggcontext,
+														VARSIZE(num));
+
+			memcpy(copy, num, VARSIZE(num));
+			*(Numeric *) element = copy;
+			break;
+		}
+	}
+}
+
+/*
+ * Random numbers for the sampling, using the splitmix64 generator - it's
+ * much cheaper than random(), and good enough for this purpose.
+ */
+static uint64
+sampler_random_uint64(quantile_sampler *sampler)
+{
+	uint64	z = (sampler->rngstate += UINT64CONST(0x9E3779B97F4A7C15));
+
+	z = (z ^ (z >> 30)) * UINT64CONST(0xBF58476D1CE4E5B9);
+	z = (z ^ (z >> 27)) * UINT64CONST(0x94D049BB133111EB);
+
+	return z ^ (z >> 31);
+}
+
+static double
+sampler_random(quantile_sampler *sampler)
+{
+	/* uniform in (0,1) - 53 random bits, shifted by 1/2 to never return 0 */
+	return ((sampler_random_uint64(sampler) >> 11) + 0.5) / 9007199254740992.0;
+}
+
+/*
+ * Compute the position of the next value to put into the reservoir
+ * (Algorithm L, Li 1994). The number of skipped values is geometric,
+ * with the success probability W.
+ */
+static void
+sampler_skip(quantile_sampler *sampler)
+{
+	double	skip = floor(log(sampler_random(sampler)) / log1p(-sampler->W));
+
+	/* the skip may be huge for tiny W values (we'll never sample again) */
+	if (skip >= (double) (PG_INT64_MAX - sampler->nseen - 1))
+		sampler->nextsample = PG_INT64_MAX;
+	else
+		sampler->nextsample = sampler->nseen + (int64) skip + 1;
+}
+
+/*
+ * Allocate a new Greenwald-Khanna state, reading the quantiles (argument 2)
+ * and epsilon (argument 3) from the function call. The sketches built by
+ * quantile_sketch_agg only get the epsilon (argument 2), no quantiles.
+ */
+static quantile_eps_state *
+eps_state_create(FunctionCallInfo fcinfo, int type)
+{
+	quantile_eps_state *state;
+
+	if (PG_NARGS() == 3)
+	{
+		if (PG_ARGISNULL(2))
+			elog(ERROR, "epsilon must not be NULL");
+
+		return eps_state_alloc(type, PG_GETARG_FLOAT8(2));
+	}
+
+	if (PG_ARGISNULL(2) || PG_ARGISNULL(3))
+		elog(ERROR, "quantiles and epsilon must not be NULL");
+
+	state = eps_state_alloc(type, PG_GETARG_FLOAT8(3));
+
+	/* read the array of quantiles */
+	state->quantiles = array_to_double(fcinfo, PG_GETARG_ARRAYTYPE_P(2),
+									   &state->nquantiles);
+
+	check_quantiles(state->nquantiles, state->quantiles);
+
+	return state;
+}
+
+/*
+ * Allocate an empty Greenwald-Khanna state (without any quantiles).
+ */
+static quantile_eps_state *
+eps_state_alloc(int type, double epsilon)
+{
+	quantile_eps_state *state;
+	Size		elsize = quantile_type_size(type);
+
+	state = (quantile_eps_state *) palloc0(sizeof(quantile_eps_state));
+
+	state->type = type;
+	state->epsilon = epsilon;
+	state->context = CurrentMemoryContext;
+
+	if (!(state->epsilon > 0 && state->epsilon < 1))
+		elog(ERROR, "invalid epsilon value %f - needs to be in (0,1)",
+			 state->epsilon);
+
+	/* larger buffers for smaller epsilon values (larger summaries) */
+	state->maxbuffered = QUANTILE_EPS_MIN_BUFFER;
+	if (1.0 / state->epsilon > state->maxbuffered)
+		state->maxbuffered = (int) Min(1.0 / state->epsilon,
+									   QUANTILE_EPS_MAX_BUFFER);
+
+	state->buffer = palloc(elsize * state->maxbuffered);
+
+	state->maxtuples = QUANTILE_MIN_ELEMENTS;
+	state->values = palloc(elsize * state->maxtuples);
+	state->tuples = (gk_tuple *) palloc(sizeof(gk_tuple) * state->maxtuples);
+
+	return state;
+}
+
+/*
+ * Free a Greenwald-Khanna state, including the numeric values.
+ */
+static void
+eps_state_free(quantile_eps_state *state)
+{
+	int		i;
+
+	if (state->type == QUANTILE_TYPE_NUMERIC)
+	{
+		for (i = 0; i < state->ntuples; i++)
+			pfree(((Numeric *) state->values)[i]);
+
+		for (i = 0; i < state->nbuffered; i++)
+			pfree(((Numeric *) state->buffer)[i]);
+	}
+
+	if (state->quantiles != NULL)
+		pfree(state->quantiles);
+
+	pfree(state->values);
+	pfree(state->tuples);
+	pfree(state->buffer);
+	pfree(state);
+}
+
+static void
+eps_state_add(quantile_eps_state *state, void *value)
+{
+	Size	elsize = quantile_type_size(state->type);
+
+	if (state->nbuffered == state->maxbuffered)
+		eps_state_flush(state);
+
+	memcpy((char *) state->buffer + state->nbuffered * elsize, value, elsize);
+	state->nbuffered++;
+}
+
+/* make sure the values/tuples arrays have space for ntuples tuples */
+static void
+eps_state_reserve(quantile_eps_state *state, int ntuples)
+{
+	if (ntuples <= state->maxtuples)
+		return;
+
+	while (state->maxtuples < ntuples)
+		state->maxtuples *= 2;
+
+	state->values = repalloc(state->values,
+							 quantile_type_size(state->type) * state->maxtuples);
+	state->tuples = (gk_tuple *) repalloc(state->tuples,
+										  sizeof(gk_tuple) * state->maxtuples);
+}
+
+/*
+ * Compress the summary by merging each tuple into its successor, as long
+ * as that does not break the (g + delta <= 2 * epsilon * count) invariant.
+ * The first and last tuples are kept, so that min/max remain exact.
+ */
+static void
+eps_state_compress(quantile_eps_state *state)
+{
+	int		i;
+	int		k;
+	Size	elsize = quantile_type_size(state->type);
+	char   *values = (char *) state->values;
+	int64	threshold = (int64) floor(2 * state->epsilon * state->count);
+
+	if (state->ntuples <= 2)
+		return;
+
+	/* k is the position of the tuple we're merging into (from the end) */
+	k = state->ntuples - 1;
+
+	for (i = state->ntuples - 2; i >= 1; i--)
+	{
+		gk_tuple   *next = &state->tuples[k];
+
+		if (state->tuples[i].g + next->g + next->delta <= threshold)
+		{
+			next->g += state->tuples[i].g;
+
+			if (state->type == QUANTILE_TYPE_NUMERIC)
+				pfree(((Numeric *) state->values)[i]);
+
+			continue;
+		}
+
+		k--;
+		state->tuples[k] = state->tuples[i];
+		memcpy(values + k * elsize, values + i * elsize, elsize);
+	}
+
+	/* the first tuple is always kept */
+	k--;
+	state->tuples[k] = state->tuples[0];
+	memcpy(values + k * elsize, values, elsize);
+
+	state->ntuples -= k;
+
+	memmove(state->tuples, &state->tuples[k], sizeof(gk_tuple) * state->ntuples);
+	memmove(values, values + k * elsize, elsize * state->ntuples);
+}
+
+/*
+ * Add the buffered values to the summary. The buffer is sorted and then
+ * merged into the summary - this is equivalent to inserting the values
+ * one by one, each new tuple getting (delta = g + delta - 1) of the next
+ * tuple (or 0 for a new minimum/maximum), as in the original algorithm.
+ */
+static void
+eps_state_flush(quantile_eps_state *state)
+{
+	int		i,
+			j,
+			k;
+	Size	elsize = quantile_type_size(state->type);
+	int		(*cmp) (const void *a, const void *b);
+	int		ntuples = state->ntuples;
+	char   *values;
+	char   *buffer = (char *) state->buffer;
+	gk_tuple *tuples;
+
+	if (state->nbuffered == 0)
+		return;
+
+	cmp = quantile_type_comparator(state->type);
+
+	quantile_sort(buffer, state->nbuffered, state->type);
+
+	/* copy the current tuples, and merge them with the buffer */
+	values = palloc(elsize * ntuples);
+	tuples = (gk_tuple *) palloc(sizeof(gk_tuple) * ntuples);
+
+	memcpy(values, state->values, elsize * ntuples);
+	memcpy(tuples, state->tuples, sizeof(gk_tuple) * ntuples);
+
+	eps_state_reserve(state, ntuples + state->nbuffered);
+
+	i = j = k = 0;
+	while ((i < ntuples) || (j < state->nbuffered))
+	{
+		if ((j < state->nbuffered) &&
+			((i == ntuples) || (cmp(buffer + j * elsize, values + i * elsize) < 0)))
+		{
+			memcpy((char *) state->values + k * elsize, buffer + j * elsize, elsize);
+
+			state->tuples[k].g = 1;
+
+			/* new minimum or maximum is exact */
+			if ((i == 0) || (i == ntuples))
+				state->tuples[k].delta = 0;
+			else
+				state->tuples[k].delta = tuples[i].g + tuples[i].delta - 1;
+
+			j++;
+		}
+		else
+		{
+			memcpy((char *) state->values + k * elsize, values + i * elsize, elsize);
+			state->tuples[k] = tuples[i];
+			i++;
+		}
+
+		k++;
+	}
+
+	state->ntuples = k;
+	state->count += state->nbuffered;
+	state->nbuffered = 0;
+
+	pfree(values);
+	pfree(tuples);
+
+	eps_state_compress(state);
+}
+
+/*
+ * Find values for the requested quantiles - for each quantile, pick the
+ * tuple whose rank interval [rmin, rmax] is closest to the requested rank.
+ * The invariant guarantees the error is at most (epsilon * count).
+ */
+static void
+eps_state_query(quantile_eps_state *state, void *result)
+{
+	int		i,
+			j;
+	Size	elsize = quantile_type_size(state->type);
+
+	eps_state_flush(state);
+
+	for (i = 0; i < state->nquantiles; i++)
+	{
+		int64	rank = 1;
+		int64	rmin = 0;
+		int64	besterr = PG_INT64_MAX;
+		int		best = 0;
+
+		if (state->quantiles[i] > 0)
+			rank = (int64) ceil(state->count * state->quantiles[i]);
+
+		for (j = 0; j < state->ntuples; j++)
+		{
+			int64	err;
+			int64	rmax;
+
+			rmin += state->tuples[j].g;
+			rmax = rmin + state->tuples[j].delta;
+
+			err = Max(rank - rmin, rmax - rank);
+
+			if (err < besterr)
+			{
+				besterr = err;
+				best = j;
+			}
+
+			/* the following tuples can't have a lower error */
+			if (rmin - rank >= besterr)
+				break;
+		}
+
+		memcpy((char *) result + i * elsize,
+			   (char *) state->values + best * elsize, elsize);
+	}
+}
+
+/*
+ * Merge two summaries into a new one. For a tuple from summary A, the
+ * rank bounds in the merged summary are
+ *
+ *     rmin = rmin_A(i) + rmin_B(last tuple of B before it)
+ *     rmax = rmax_A(i) + rmax_B(first tuple of B after it) - 1
+ *
+ * (with rmin_B = 0 / rmax_B - 1 = count_B when there's no such tuple), and
+ * the other way around for tuples from B. The gaps between consecutive
+ * tuples are at most (2 * epsilon * count_A + 2 * epsilon * count_B), so
+ * the merged summary still satisfies the invariant.
+ *
+ * Either summary may be NULL (but not both). The result is allocated in
+ * the current memory context, including the values.
+ */
+static quantile_eps_state *
+eps_state_merge(quantile_eps_state *a, quantile_eps_state *b)
+{
+	int		i,
+			j,
+			k;
+	quantile_eps_state *state;
+	quantile_eps_state *src = (a != NULL) ? a : b;
+	Size	elsize = quantile_type_size(src->type);
+	int		(*cmp) (const void *a, const void *b);
+	int64  *rmin_a,
+		   *rmax_a,
+		   *rmin_b,
+		   *rmax_b;
+	int		na = 0,
+			nb = 0;
+	int64	count_a = 0,
+			count_b = 0;
+	int64	prev = 0;
+
+	Assert(src != NULL);
+
+	cmp = quantile_type_comparator(src->type);
+
+	if (a != NULL)
+	{
+		eps_state_flush(a);
+		na = a->ntuples;
+		count_a = a->count;
+	}
+
+	if (b != NULL)
+	{
+		eps_state_flush(b);
+		nb = b->ntuples;
+		count_b = b->count;
+	}
+
+	if ((a != NULL) && (b != NULL) && (a->type != b->type))
+		elog(ERROR, "cannot merge quantile summaries of different types");
+
+	state = (quantile_eps_state *) palloc0(sizeof(quantile_eps_state));
+
+	state->type = src->type;
+	state->context = CurrentMemoryContext;
+	state->nquantiles = src->nquantiles;
+	state->quantiles = (double *) palloc(sizeof(double) * src->nquantiles);
+	memcpy(state->quantiles, src->quantiles, sizeof(double) * src->nquantiles);
+
+	/* the error is the same for both summaries, but better be careful */
+	state->epsilon = Max((a != NULL) ? a->epsilon : 0,
+						 (b != NULL) ? b->epsilon : 0);
+
+	state->maxbuffered = src->maxbuffered;
+	state->buffer = palloc(elsize * state->maxbuffered);
+
+	state->count = count_a + count_b;
+	state->maxtuples = Max(na + nb, 1);
+	state->values = palloc(elsize * state->maxtuples);
+	state->tuples = (gk_tuple *) palloc(sizeof(gk_tuple) * state->maxtuples);
+
+	/* compute the rank bounds for both summaries */
+	rmin_a = (int64 *) palloc(sizeof(int64) * (na + 1));
+	rmax_a = (int64 *) palloc(sizeof(int64) * (na + 1));
+	rmin_b = (int64 *) palloc(sizeof(int64) * (nb + 1));
+	rmax_b = (int64 *) palloc(sizeof(int64) * (nb + 1));
+
+	for (i = 0; i < na; i++)
+	{
+		rmin_a[i] = a->tuples[i].g + ((i > 0) ? rmin_a[i-1] : 0);
+		rmax_a[i] = rmin_a[i] + a->tuples[i].delta;
+	}
+
+	for (j = 0; j < nb; j++)
+	{
+		rmin_b[j] = b->tuples[j].g + ((j > 0) ? rmin_b[j-1] : 0);
+		rmax_b[j] = rmin_b[j] + b->tuples[j].delta;
+	}
+
+	i = j = k = 0;
+	while ((i < na) || (j < nb))
+	{
+		int64	rmin;
+		int64	rmax;
+		void   *value;
+
+		if ((i < na) &&
+			((j == nb) || (cmp((char *) a->values + i * elsize,
+							   (char *) b->values + j * elsize) <= 0)))
+		{
+			value = (char *) a->values + i * elsize;
+
+			rmin = rmin_a[i] + ((j > 0) ? rmin_b[j-1] : 0);
+			rmax = rmax_a[i] + ((j < nb) ? (rmax_b[j] - 1) : count_b);
+
+			i++;
+		}
+		else
+		{
+			value = (char *) b->values + j * elsize;
+
+			rmin = rmin_b[j] + ((i > 0) ? rmin_a[i-1] : 0);
+			rmax = rmax_b[j] + ((i < na) ? (rmax_a[i] - 1) : count_a);
+
+			j++;
+		}
+
+		if (state->type == QUANTILE_TYPE_NUMERIC)
+		{
+			Numeric	num = *(Numeric *) value;
+			Numeric	copy = (Numeric) palloc(VARSIZE(num));
+
+			memcpy(copy, num, VARSIZE(num));
+			((Numeric *) state->values)[k] = copy;
+		}
+		else
+			memcpy((char *) state->values + k * elsize, value, elsize);
+
+		state->tuples[k].g = rmin - prev;
+		state->tuples[k].delta = rmax - rmin;
+
+		prev = rmin;
+		k++;
+	}
+
+	state->ntuples = k;
+
+	pfree(rmin_a);
+	pfree(rmax_a);
+	pfree(rmin_b);
+	pfree(rmax_b);
+
+	eps_state_compress(state);
+
+	return state;
+}
+
+/*
+ * Return pointer to the values of a one-dimensional (or flattened) array
+ * of a fixed-length by-value type. Without NULLs that's just the array
+ * data (no copy), otherwise the non-NULL values are copied into a new
+ * buffer. For numeric arrays we always build a new array of (detoasted)
+ * pointers to the non-NULL values.
+ */
+static char *
+array_values(ArrayType *array, int type, int *len)
+{
+	int		i;
+	int		nitems;
+	Size	elsize = quantile_type_size(type);
+	Oid		elemtype;
+	bits8  *bitmap;
+	int		bitmask;
+	char   *src;
+	char   *dst;
+	char   *result;
+
+	switch (type)
+	{
+		case QUANTILE_TYPE_INT32:
+			elemtype = INT4OID;
+			break;
+		case QUANTILE_TYPE_INT64:
+			elemtype = INT8OID;
+			break;
+		case QUANTILE_TYPE_DOUBLE:
+			elemtype = FLOAT8OID;
+			break;
+		case QUANTILE_TYPE_NUMERIC:
+			elemtype = NUMERICOID;
+			break;
+		default:
+			elog(ERROR, "unsupported quantile data type %d", type);
+	}
+
+	if (ARR_ELEMTYPE(array) != elemtype)
+		elog(ERROR, "unexpected array element type %u (expected %u)",
+			 ARR_ELEMTYPE(array), elemtype);
+
+	if (type == QUANTILE_TYPE_NUMERIC)
+	{
+		Datum  *datums;
+		bool   *nulls;
+		Numeric *numerics;
+
+		deconstruct_array(array, NUMERICOID, -1, false, 'i',
+						  &datums, &nulls, &nitems);
+
+		numerics = (Numeric *) palloc(sizeof(Numeric) * Max(nitems, 1));
+
+		*len = 0;
+		for (i = 0; i < nitems; i++)
+		{
+			if (!nulls[i])
+				numerics[(*len)++] = DatumGetNumeric(datums[i]);
+		}
+
+		return (char *) numerics;
+	}
+
+	nitems = ArrayGetNItems(ARR_NDIM(array), ARR_DIMS(array));
+
+	if (!ARR_HASNULL(array))
+	{
+		*len = nitems;
+		return ARR_DATA_PTR(array);
+	}
+
+	/* the types are aligned to their length, so no padding between values */
+	result = palloc(elsize * Max(nitems, 1));
+
+	src = ARR_DATA_PTR(array);
+	dst = result;
+	bitmap = ARR_NULLBITMAP(array);
+	bitmask = 1;
+
+	for (i = 0; i < nitems; i++)
+	{
+		if (*bitmap & bitmask)
+		{
+			memcpy(dst, src, elsize);
+			src += elsize;
+			dst += elsize;
+		}
+
+		bitmask <<= 1;
+		if (bitmask == 0x100)
+		{
+			bitmap++;
+			bitmask = 1;
+		}
+	}
+
+	*len = (dst - result) / elsize;
+
+	return result;
+}
+
+/*
+ * Append a batch of values to the state, enlarging the array just once.
+ * For int64/double states with quantile.spill_mem set, we copy the values
+ * in chunks fitting into the current array, and let quantile_make_room()
+ * decide whether to grow the array or spill the values.
+ */
+static void
+state_append_values(quantile_state *state, int type, char *values, int nvalues)
+{
+	Size	elsize = quantile_type_size(type);
+
+	if (state->spillable && !state->partial &&
+		((state->spill != NULL) || (quantile_spill_mem > 0)))
+	{
+		while (nvalues > 0)
+		{
+			int		n;
+
+			if (state->nelements == state->maxelements)
+				quantile_make_room(state, (type == QUANTILE_TYPE_DOUBLE));
+
+			n = Min(nvalues, state->maxelements - state->nelements);
+
+			memcpy((char *) state->elements + state->nelements * elsize,
+				   values, n * elsize);
+
+			state->nelements += n;
+			values += n * elsize;
+			nvalues -= n;
+		}
+
+		return;
+	}
+
+	if ((int64) state->nelements + nvalues > state->maxelements)
+		state_grow(state, elsize, (int64) state->nelements + nvalues);
+
+	memcpy((char *) state->elements + state->nelements * elsize,
+		   values, nvalues * elsize);
+
+	state->nelements += nvalues;
+}
+
+/*
+ * Add a sorted run of values to the state (the values are not copied).
+ */
+static void
+state_add_run(quantile_state *state, void *elements, int nelements)
+{
+	if (state->nruns == state->maxruns)
+	{
+		state->maxruns = Max(4, state->maxruns * 2);
+
+		if (state->runs == NULL)
+			state->runs = (quantile_run *) palloc(sizeof(quantile_run) * state->maxruns);
+		else
+			state->runs = (quantile_run *) repalloc(state->runs,
+													sizeof(quantile_run) * state->maxruns);
+	}
+
+	state->runs[state->nruns].elements = elements;
+	state->runs[state->nruns].nelements = nelements;
+	state->nruns++;
+}
+
+/*
+ * Make room for another value in the elements array. Until the array
+ * reaches QUANTILE_BLOCK_ELEMENTS values it's simply enlarged. After that
+ * each full block gets sorted right away (while it's still in the CPU
+ * cache) and becomes a new sorted run, and we start filling a new block.
+ *
+ * To keep the number of runs low, a new run is merged with the last run
+ * whenever that one is not larger (so the run lengths are decreasing
+ * powers of two blocks, and there are only about log2(nblocks) runs).
+ * So the sorting is done incrementally while accumulating the values,
+ * and the final function only needs to search a couple of runs.
+ *
+ * That does not apply to a single quantile, which the final function
+ * selects without sorting all the values (see quantile_select).
+ */
+static void
+state_sort_block(quantile_state *state, int type)
+{
+	Size			elsize = quantile_type_size(type);
+	char		   *run;
+	int				nrun;
+	MemoryContext	oldcontext;
+
+	Assert(state->nelements == state->maxelements);
+
+	if ((state->maxelements < QUANTILE_BLOCK_ELEMENTS) ||
+		((state->nquantiles == 1) && (state->nruns == 0)))
+	{
+		state_grow(state, elsize, (int64) state->nelements + 1);
+		return;
+	}
+
+	quantile_sort(state->elements, state->nelements, type);
+
+	run = (char *) state->elements;
+	nrun = state->nelements;
+
+	oldcontext = MemoryContextSwitchTo(state->aggcontext);
+
+	while ((state->nruns > 0) &&
+		   (state->runs[state->nruns - 1].nelements <= nrun))
+	{
+		quantile_run   *last = &state->runs[state->nruns - 1];
+		char		   *merged;
+
+		if ((int64) last->nelements + nrun > INT_MAX)
+			elog(ERROR, "too many values in the quantile state");
+
+		merged = MemoryContextAllocHuge(state->aggcontext,
+										elsize * (last->nelements + nrun));
+
+		merge_runs(last->elements, last->nelements, run, nrun, merged, type);
+
+		pfree(last->elements);
+		pfree(run);
+
+		run = merged;
+		nrun += last->nelements;
+
+		state->nruns--;
+	}
+
+	state_add_run(state, run, nrun);
+
+	state->elements = palloc(elsize * state->maxelements);
+	state->nelements = 0;
+
+	MemoryContextSwitchTo(oldcontext);
+}
+
+/*
+ * Merge two sorted arrays of values into the result array. Equal values
+ * are taken from the first array first. The fixed-length types are merged
+ * directly (doubles compared as keys, so that NaN sorts last), which is
+ * much faster than calling the comparator for each value.
+ */
+#define MERGE_RUNS(type, less)	\
+	do {	\
+		type   *x = (type *) a;	\
+		type   *y = (type *) b;	\
+		type   *r = (type *) result;	\
+		int		i = 0,	\
+				j = 0;	\
+		while ((i < na) && (j < nb))	\
+			*r++ = less(y[j], x[i]) ? y[j++] : x[i++];	\
+		while (i < na)	\
+			*r++ = x[i++];	\
+		while (j < nb)	\
+			*r++ = y[j++];	\
+	} while (0)
+
+#define MERGE_LESS(p, q)			((p) < (q))
+#define MERGE_LESS_DOUBLE(p, q)		(double_to_key(p) < double_to_key(q))
+#define MERGE_LESS_NUMERIC(p, q)	(numeric_comparator(&(p), &(q)) < 0)
+
+static void
+merge_runs(char *a, int na, char *b, int nb, char *result, int type)
+{
+	switch (type)
+	{
+		case QUANTILE_TYPE_INT32:
+			MERGE_RUNS(int32, MERGE_LESS);
+			break;
+
+		case QUANTILE_TYPE_INT64:
+			MERGE_RUNS(int64, MERGE_LESS);
+			break;
+
+		case QUANTILE_TYPE_DOUBLE:
+			MERGE_RUNS(double, MERGE_LESS_DOUBLE);
+			break;
+
+		case QUANTILE_TYPE_NUMERIC:
+			MERGE_RUNS(Numeric, MERGE_LESS_NUMERIC);
+			break;
+
+		default:
+			elog(ERROR, "unsupported quantile data type %d", type);
+	}
+}
+
+/*
+ * Compute the requested quantiles of a state with sorted runs. The
+ * in-memory values (if any) are sorted and treated as another run.
+ *
+ * For each quantile we maintain a window [lo, hi) in each run, with the
+ * value we're looking for somewhere in the windows. In each step we pick
+ * the median of the largest window as a pivot, count the values smaller
+ * than / equal to the pivot in all windows (binary search), and either
+ * return the pivot or shrink all the windows to one side of it. The
+ * largest window is at least halved in each step, so the number of steps
+ * is about (nruns * log(nelements)), and each step does nruns binary
+ * searches - much cheaper than sorting all the values again.
+ */
+static void
+state_runs_quantiles(quantile_state *state, int type, char *result)
+{
+	int		i,
+			r;
+	int		nruns = 0;
+	Size	elsize = quantile_type_size(type);
+	int		(*cmp) (const void *a, const void *b) = quantile_type_comparator(type);
+	char  **runs;
+	int	   *lengths;
+	int	   *lo,
+		   *hi,
+		   *lt,
+		   *le;
+	int64	total = 0;
+
+	runs = (char **) palloc(sizeof(char *) * (state->nruns + 1));
+	lengths = (int *) palloc(sizeof(int) * (state->nruns + 1));
+
+	for (r = 0; r < state->nruns; r++)
+	{
+		runs[nruns] = (char *) state->runs[r].elements;
+		lengths[nruns++] = state->runs[r].nelements;
+	}
+
+	if (state->nelements > 0)
+	{
+		quantile_sort(state->elements, state->nelements, type);
+
+		runs[nruns] = (char *) state->elements;
+		lengths[nruns++] = state->nelements;
+	}
+
+	for (r = 0; r < nruns; r++)
+		total += lengths[r];
+
+	lo = (int *) palloc(sizeof(int) * nruns);
+	hi = (int *) palloc(sizeof(int) * nruns);
+	lt = (int *) palloc(sizeof(int) * nruns);
+	le = (int *) palloc(sizeof(int) * nruns);
+
+	for (i = 0; i < state->nquantiles; i++)
+	{
+		int64	rank = 0;
+		char   *pivot = NULL;
+
+		if (state->quantiles[i] > 0)
+			rank = (int64) ceil(total * state->quantiles[i]) - 1;
+
+		for (r = 0; r < nruns; r++)
+		{
+			lo[r] = 0;
+			hi[r] = lengths[r];
+		}
+
+		while (true)
+		{
+			int		largest = -1;
+			int64	nless = 0,
+					nequal = 0;
+
+			for (r = 0; r < nruns; r++)
+			{
+				if ((hi[r] > lo[r]) &&
+					((largest == -1) || (hi[r] - lo[r] > hi[largest] - lo[largest])))
+					largest = r;
+			}
+
+			/* can't happen, the rank is always within the windows */
+			if (largest == -1)
+				elog(ERROR, "quantile rank not found in sorted runs");
+
+			pivot = runs[largest] + ((lo[largest] + hi[largest]) / 2) * elsize;
+
+			for (r = 0; r < nruns; r++)
+			{
+				int		a, b;
+
+				/* first value >= pivot */
+				a = lo[r];
+				b = hi[r];
+				while (a < b)
+				{
+					int		m = a + (b - a) / 2;
+
+					if (cmp(runs[r] + m * elsize, pivot) < 0)
+						a = m + 1;
+					else
+						b = m;
+				}
+				lt[r] = a;
+
+				/* first value > pivot */
+				b = hi[r];
+				while (a < b)
+				{
+					int		m = a + (b - a) / 2;
+
+					if (cmp(runs[r] + m * elsize, pivot) <= 0)
+						a = m + 1;
+					else
+						b = m;
+				}
+				le[r] = a;
+
+				/*
+				 * The pivot itself is always in the middle, which guarantees
+				 * the window shrinks even if the runs are not sorted properly
+				 * (e.g. with values that don't compare consistently).
+				 */
+				if (r == largest)
+				{
+					int		mid = (lo[r] + hi[r]) / 2;
+
+					lt[r] = Min(lt[r], mid);
+					le[r] = Max(le[r], mid + 1);
+				}
+
+				nless += lt[r] - lo[r];
+				nequal += le[r] - lt[r];
+			}
+
+			if (rank < nless)
+			{
+				for (r = 0; r < nruns; r++)
+					hi[r] = lt[r];
+			}
+			else if (rank < nless + nequal)
+				break;
+			else
+			{
+				rank -= (nless + nequal);
+
+				for (r = 0; r < nruns; r++)
+					lo[r] = le[r];
+			}
+		}
+
+		memcpy(result + i * elsize, pivot, elsize);
+	}
+}
+
+/*
+ * Send/receive a single value of the given type (numerics as length
+ * and the varlena bytes).
+ */
+static void
+send_element(StringInfo buf, int type, char *element)
+{
+	switch (type)
+	{
+		case QUANTILE_TYPE_INT32:
+			pq_sendint32(buf, *(int32 *) element);
+			break;
+
+		case QUANTILE_TYPE_INT64:
+			pq_sendint64(buf, *(int64 *) element);
+			break;
+
+		case QUANTILE_TYPE_DOUBLE:
+			pq_sendfloat8(buf, *(double *) element);
+			break;
+
+		case QUANTILE_TYPE_NUMERIC:
+		{
+			Numeric	num = *(Numeric *) element;
+
+			pq_sendint32(buf, VARSIZE(num));
+			pq_sendbytes(buf, (char *) num, VARSIZE(num));
+			break;
+		}
+	}
+}
+
+/* numerics are allocated in the current memory context */
+static void
+recv_element(StringInfo buf, int type, char *element)
+{
+	switch (type)
+	{
+		case QUANTILE_TYPE_INT32:
+			*(int32 *) element = pq_getmsgint(buf, 4);
+			break;
+
+		case QUANTILE_TYPE_INT64:
+			*(int64 *) element = pq_getmsgint64(buf);
+			break;
+
+		case QUANTILE_TYPE_DOUBLE:
+			*(double *) element = pq_getmsgfloat8(buf);
+			break;
+
+		case QUANTILE_TYPE_NUMERIC:
+		{
+			int		len = pq_getmsgint(buf, 4);
+			Numeric	num = (Numeric) palloc(len);
+
+			pq_copymsgbytes(buf, (char *) num, len);
+			*(Numeric *) element = num;
+			break;
+		}
+
+		default:
+			elog(ERROR, "unknown quantile data type %d", type);
+	}
+}
+
+/*
+ * Create an empty quantile_columns state (in the current memory context),
+ * with the quantiles already parsed and checked.
+ */
+static quantile_columns_state *
+columns_state_create(int ncolumns, int nquantiles, double *quantiles)
+{
+	int		i;
+	quantile_columns_state *state;
+
+	state = (quantile_columns_state *) palloc(sizeof(quantile_columns_state));
+
+	state->nquantiles = nquantiles;
+	state->quantiles = quantiles;
+
+	state->ncolumns = ncolumns;
+	state->nelements = (int *) palloc0(sizeof(int) * Max(ncolumns, 1));
+	state->maxelements = (int *) palloc(sizeof(int) * Max(ncolumns, 1));
+	state->columns = (double **) palloc(sizeof(double *) * Max(ncolumns, 1));
+
+	for (i = 0; i < ncolumns; i++)
+	{
+		state->maxelements[i] = QUANTILE_MIN_ELEMENTS;
+		state->columns[i] = (double *) palloc(sizeof(double) * QUANTILE_MIN_ELEMENTS);
+	}
+
+	return state;
+}
+
+/*
+ * Enlarge buffer of one quantile_columns column to at least nelements
+ * values (by doubling it, just like state_grow).
+ */
+static void
+columns_grow(quantile_columns_state *state, int column, int64 nelements)
+{
+	int64	maxelements = state->maxelements[column];
+
+	if (maxelements >= nelements)
+		return;
+
+	while (maxelements < nelements)
+		maxelements *= 2;
+
+	maxelements = Min(maxelements, INT_MAX);
+
+	if ((Size) maxelements > MaxAllocHugeSize / sizeof(double))
+		maxelements = MaxAllocHugeSize / sizeof(double);
+
+	if (maxelements < nelements)
+		elog(ERROR, "too many values in the quantile state");
+
+	state->columns[column] = repalloc_huge(state->columns[column],
+										   sizeof(double) * maxelements);
+	state->maxelements[column] = (int) maxelements;
+}
+
+/*
+ * Remove duplicates from sorted values (in place), return the number of
+ * distinct values. Optionally free the duplicate numerics.
+ */
+static int
+distinct_compact(char *values, int nvalues, int type, bool free_values)
+{
+	int		i;
+	int		ndistinct = 1;
+	Size	elsize = quantile_type_size(type);
+	int		(*cmp) (const void *a, const void *b) = quantile_type_comparator(type);
+
+	if (nvalues == 0)
+		return 0;
+
+	for (i = 1; i < nvalues; i++)
+	{
+		char   *value = values + (Size) i * elsize;
+
+		if (cmp(values + (Size) (ndistinct - 1) * elsize, value) != 0)
+			memcpy(values + (Size) (ndistinct++) * elsize, value, elsize);
+		else if (free_values && (type == QUANTILE_TYPE_NUMERIC))
+			pfree(*(Numeric *) value);
+	}
+
+	return ndistinct;
+}
+
+/*
+ * Convert int32/int64/double values to order-preserving keys, in place.
+ * The int32 values get 32-bit keys, so that they fit into the array too
+ * and we don't need to allocate a separate array of keys.
+ */
+static void
+elements_to_keys(void *elements, int nelements, int type)
+{
+	int		i;
+
+	switch (type)
+	{
+		case QUANTILE_TYPE_INT32:
+			for (i = 0; i < nelements; i++)
+				((uint32 *) elements)[i] = int32_to_key(((int32 *) elements)[i]);
+			break;
+
+		case QUANTILE_TYPE_INT64:
+			for (i = 0; i < nelements; i++)
+				((uint64 *) elements)[i] = int64_to_key(((int64 *) elements)[i]);
+			break;
+
+		case QUANTILE_TYPE_DOUBLE:
+			for (i = 0; i < nelements; i++)
+				((uint64 *) elements)[i] = double_to_key(((double *) elements)[i]);
+			break;
+
+		default:
+			elog(ERROR, "unsupported quantile data type %d", type);
+	}
+}
+
+/*
+ * Convert the keys back to values (in place).
+ */
+static void
+keys_to_elements(void *elements, int nelements, int type)
+{
+	int		i;
+
+	switch (type)
+	{
+		case QUANTILE_TYPE_INT32:
+			for (i = 0; i < nelements; i++)
+				((int32 *) elements)[i] = key_to_int32(((uint32 *) elements)[i]);
+			break;
+
+		case QUANTILE_TYPE_INT64:
+			for (i = 0; i < nelements; i++)
+				((int64 *) elements)[i] = key_to_int64(((uint64 *) elements)[i]);
+			break;
+
+		case QUANTILE_TYPE_DOUBLE:
+			for (i = 0; i < nelements; i++)
+				((double *) elements)[i] = key_to_double(((uint64 *) elements)[i]);
+			break;
+	}
+}
+
+/*
+ * The kernels work with both 32-bit keys (int32) and 64-bit keys (int64
+ * and double), so the code is written as macros with the type of the
+ * keys as a parameter, and the functions simply pick the right one. The
+ * minimum and maximum keys are passed as uint64 in both cases.
+ */
+
+/*
+ * Determine the range of keys, and whether they are sorted already.
+ */
+#define KEYS_RANGE(type)	\
+	do {	\
+		type   *k = (type *) keys;	\
+		int		i;	\
+		*min = *max = k[0];	\
+		for (i = 1; i < nkeys; i++)	\
+		{	\
+			if (k[i] < k[i - 1])	\
+				sorted = false;	\
+			if (k[i] < *min)	\
+				*min = k[i];	\
+			else if (k[i] > *max)	\
+				*max = k[i];	\
+		}	\
+	} while (0)
+
+static bool
+keys_range(void *keys, int nkeys, bool wide, uint64 *min, uint64 *max)
+{
+	bool	sorted = true;
+
+	if (wide)
+		KEYS_RANGE(uint64);
+	else
+		KEYS_RANGE(uint32);
+
+	return sorted;
+}
+
+/*
+ * Counting sort of keys within a small range [min, max] - count the keys
+ * and then simply write them out in order.
+ */
+#define COUNTING_SORT_KEYS(type)	\
+	do {	\
+		type   *k = (type *) keys;	\
+		int		i,	\
+				j,	\
+				n = 0;	\
+		for (i = 0; i < nkeys; i++)	\
+			counts[k[i] - min]++;	\
+		for (i = 0; i < range; i++)	\
+			for (j = 0; j < counts[i]; j++)	\
+				k[n++] = (type) (min + i);	\
+	} while (0)
+
+static void
+counting_sort_keys(void *keys, int nkeys, bool wide, uint64 min, uint64 max)
+{
+	int		range = (int) (max - min) + 1;
+	int	   *counts = (int *) palloc0(sizeof(int) * range);
+
+	if (wide)
+		COUNTING_SORT_KEYS(uint64);
+	else
+		COUNTING_SORT_KEYS(uint32);
+
+	pfree(counts);
+}
+
+/*
+ * LSD radix sort of keys, one byte at a time. All the keys share the bits
+ * above the highest bit in which min and max differ, so we only need to
+ * look at the bytes below that. Passes where all the keys have the same
+ * byte are skipped too. This needs a temporary array of the same size as
+ * the keys.
+ */
+#define RADIX_SORT_KEYS(type)	\
+	do {	\
+		type   *src = (type *) keys;	\
+		type   *dst = (type *) tmp;	\
+		int		i;	\
+		int		shift;	\
+		for (shift = 0; (shift < 64) && ((diff >> shift) != 0); shift += 8)	\
+		{	\
+			int		offset = 0;	\
+			type   *swap;	\
+			memset(counts, 0, sizeof(counts));	\
+			for (i = 0; i < nkeys; i++)	\
+				counts[(src[i] >> shift) & 0xFF]++;	\
+			if (counts[(src[0] >> shift) & 0xFF] == nkeys)	\
+				continue;	\
+			/* turn the counts into offsets */	\
+			for (i = 0; i < 256; i++)	\
+			{	\
+				int		count = counts[i];	\
+				counts[i] = offset;	\
+				offset += count;	\
+			}	\
+			for (i = 0; i < nkeys; i++)	\
+				dst[counts[(src[i] >> shift) & 0xFF]++] = src[i];	\
+			swap = src;	\
+			src = dst;	\
+			dst = swap;	\
+		}	\
+		if (src != (type *) keys)	\
+			memcpy(keys, src, sizeof(type) * nkeys);	\
+	} while (0)
+
+static void
+radix_sort_keys(void *keys, int nkeys, bool wide, uint64 min, uint64 max)
+{
+	uint64	diff = min ^ max;
+	int		counts[256];
+	void   *tmp;
+
+	tmp = MemoryContextAllocHuge(CurrentMemoryContext,
+								 (wide ? sizeof(uint64) : sizeof(uint32)) * nkeys);
+
+	if (wide)
+		RADIX_SORT_KEYS(uint64);
+	else
+		RADIX_SORT_KEYS(uint32);
+
+	pfree(tmp);
+}
+
+/*
+ * Return the k-th smallest key (0-based), using quickselect with a three-way
+ * partitioning (so that many duplicate keys are not a problem) and the
+ * median of three as a pivot. If that takes too many rounds, we simply
+ * sort the remaining part (that's the "intro" part of introselect).
+ */
+#define SELECT_KEY(type, comparator)	\
+	do {	\
+		type   *keys = (type *) data;	\
+		int		lo = 0,	\
+				hi = nkeys - 1;	\
+		int		rounds = 0;	\
+		while (lo < hi)	\
+		{	\
+			int		lt = lo,	\
+					gt = hi,	\
+					i = lo;	\
+			type	a = keys[lo],	\
+					b = keys[lo + (hi - lo) / 2],	\
+					c = keys[hi];	\
+			type	pivot;	\
+			type	tmp;	\
+			/* the partition does not shrink fast enough, sort it */	\
+			if (++rounds > 64)	\
+			{	\
+				qsort(keys + lo, hi - lo + 1, sizeof(type), comparator);	\
+				break;	\
+			}	\
+			if (a < b)	\
+				pivot = (b < c) ? b : ((a < c) ? c : a);	\
+			else	\
+				pivot = (a < c) ? a : ((b < c) ? c : b);	\
+			/* keys[lo..lt) < pivot, keys[lt..i) == pivot, keys(gt..hi] > pivot */	\
+			while (i <= gt)	\
+			{	\
+				if (keys[i] < pivot)	\
+				{	\
+					tmp = keys[lt];	\
+					keys[lt++] = keys[i];	\
+					keys[i++] = tmp;	\
+				}	\
+				else if (keys[i] > pivot)	\
+				{	\
+					tmp = keys[gt];	\
+					keys[gt--] = keys[i];	\
+					keys[i] = tmp;	\
+				}	\
+				else	\
+					i++;	\
+			}	\
+			if (k < lt)	\
+				hi = lt - 1;	\
+			else if (k > gt)	\
+				lo = gt + 1;	\
+			else	\
+				return pivot;	\
+		}	\
+		return keys[k];	\
+	} while (0)
+
+static uint64
+select_key(void *data, int nkeys, bool wide, int k)
+{
+	if (wide)
+		SELECT_KEY(uint64, &uint64_comparator);
+	else
+		SELECT_KEY(uint32, &uint32_comparator);
+}
+
+/*
+ * Select an extreme quantile (within QUANTILE_TAIL_FRACTION from 0 or 1)
+ * without sorting all the values. The result is the k-th largest value
+ * (k-th smallest for quantiles close to 0) for a small k, so we keep the
+ * k largest values in a min-heap (in the first k slots of the array, so
+ * no extra memory is needed), and the result ends at the top. Most values
+ * are rejected after a single comparison with the top of the heap, so
+ * that's O(n log k) instead of O(n log n). Returns false for quantiles
+ * that are not extreme enough.
+ */
+static bool
+tail_select(void *elements, int nelements, int type, double quantile,
+			char *result)
+{
+	int		i,
+			k;
+	int		idx = 0;
+	bool	top;
+	Size	elsize = quantile_type_size(type);
+	char   *heap = (char *) elements;
+	char	tmp[sizeof(int64)];
+	int		(*cmp) (const void *a, const void *b) = quantile_type_comparator(type);
+
+	Assert(elsize <= sizeof(tmp));
+
+	if (quantile > 0)
+		idx = (int) ceil(nelements * quantile) - 1;
+
+	if (quantile >= 1.0 - QUANTILE_TAIL_FRACTION)
+	{
+		top = true;
+		k = nelements - idx;
+	}
+	else if (quantile <= QUANTILE_TAIL_FRACTION)
+	{
+		top = false;
+		k = idx + 1;
+	}
+	else
+		return false;
+
+	/* doubles are compared as keys, to get NaN in the right place */
+	if (type == QUANTILE_TYPE_DOUBLE)
+	{
+		uint64 *keys = (uint64 *) elements;
+
+		for (i = 0; i < nelements; i++)
+			keys[i] = double_to_key(((double *) elements)[i]);
+
+		cmp = uint64_comparator;
+	}
+
+	for (i = k / 2 - 1; i >= 0; i--)
+		tail_sift_down(heap, k, i, elsize, top, cmp);
+
+	for (i = k; i < nelements; i++)
+	{
+		int		c = cmp(heap + (Size) i * elsize, heap);
+
+		/* not in the tail (not larger than the top of the min-heap) */
+		if ((top && (c <= 0)) || (!top && (c >= 0)))
+			continue;
+
+		memcpy(tmp, heap, elsize);
+		memcpy(heap, heap + (Size) i * elsize, elsize);
+		memcpy(heap + (Size) i * elsize, tmp, elsize);
+
+		tail_sift_down(heap, k, 0, elsize, top, cmp);
+	}
+
+	if (type == QUANTILE_TYPE_DOUBLE)
+	{
+		uint64 *keys = (uint64 *) elements;
+
+		for (i = 0; i < nelements; i++)
+			((double *) elements)[i] = key_to_double(keys[i]);
+	}
+
+	memcpy(result, heap, elsize);
+
+	return true;
+}
+
+/*
+ * Sift a value down the tail heap - a min-heap for the top tail, max-heap
+ * for the bottom one.
+ */
+static void
+tail_sift_down(char *heap, int nheap, int i, Size elsize, bool top,
+			   int (*cmp) (const void *a, const void *b))
+{
+	char	tmp[sizeof(int64)];
+
+	while (true)
+	{
+		int		c = 2 * i + 1;
+		int		r;
+
+		if (c >= nheap)
+			break;
+
+		if (c + 1 < nheap)
+		{
+			r = cmp(heap + (Size) (c + 1) * elsize, heap + (Size) c * elsize);
+
+			if ((top && (r < 0)) || (!top && (r > 0)))
+				c++;
+		}
+
+		r = cmp(heap + (Size) c * elsize, heap + (Size) i * elsize);
+
+		if ((top && (r >= 0)) || (!top && (r <= 0)))
+			break;
+
+		memcpy(tmp, heap + (Size) c * elsize, elsize);
+		memcpy(heap + (Size) c * elsize, heap + (Size) i * elsize, elsize);
+		memcpy(heap + (Size) i * elsize, tmp, elsize);
+
+		i = c;
+	}
+}
+
+/*
+ * Send sorted values in a compact form. The int32/int64/double values are
+ * mapped to order-preserving uint64 keys, and we send the differences
+ * between consecutive keys as varints (7 bits per byte, the high bit
+ * marks more bytes to follow). For sorted data the differences are small,
+ * so that's usually 1-3 bytes per value instead of 4 or 8. The difference
+ * is zigzag-encoded, so values that are not strictly ordered by the key
+ * (e.g. -0.0 and 0.0, which compare as equal) still roundtrip exactly.
+ * Numerics are sent as is.
+ */
+static void
+send_sorted_values(StringInfo buf, int type, char *values, int nvalues)
+{
+	int		i;
+	uint64	prev = int64_to_key(0);
+
+	if (type == QUANTILE_TYPE_NUMERIC)
+	{
+		for (i = 0; i < nvalues; i++)
+		{
+			Numeric	num = ((Numeric *) values)[i];
+
+			reserve_serialized(buf, sizeof(int32) + VARSIZE(num));
+
+			send_element(buf, type, (char *) &num);
+		}
+		return;
+	}
+
+	for (i = 0; i < nvalues; i++)
+	{
+		uint64	key,
+				delta;
+		unsigned char *ptr;
+
+		/* make sure there's enough space for the next chunk of varints */
+		if (i % QUANTILE_ENCODE_CHUNK == 0)
+			reserve_serialized(buf, QUANTILE_ENCODE_CHUNK * 10);
+
+		switch (type)
+		{
+			case QUANTILE_TYPE_INT32:
+				key = int64_to_key(((int32 *) values)[i]);
+				break;
+
+			case QUANTILE_TYPE_INT64:
+				key = int64_to_key(((int64 *) values)[i]);
+				break;
+
+			default:
+				key = double_to_key(((double *) values)[i]);
+				break;
+		}
+
+		delta = key - prev;
+		delta = (delta << 1) ^ (uint64) ((int64) delta >> 63);
+		prev = key;
+
+		ptr = (unsigned char *) buf->data + buf->len;
+
+		while (delta >= 0x80)
+		{
+			*ptr++ = (unsigned char) (delta | 0x80);
+			delta >>= 7;
+		}
+		*ptr++ = (unsigned char) delta;
+
+		buf->len = (char *) ptr - buf->data;
+	}
+
+	buf->data[buf->len] = '\0';
+}
+
+/*
+ * Make sure there's enough space for another len bytes in the buffer with
+ * a serialized state. A bytea value is limited to 1GB, and we prefer to
+ * fail with a clear error message instead of the generic one from
+ * enlargeStringInfo.
+ */
+static void
+reserve_serialized(StringInfo buf, Size len)
+{
+	if ((Size) buf->len + len >= MaxAllocSize - VARHDRSZ)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+				 errmsg("quantile state is too large to be serialized"),
+				 errdetail("The serialized state would exceed the 1GB limit on a bytea value.")));
+
+	enlargeStringInfo(buf, len);
+}
+
+/* decode values encoded by send_sorted_values */
+static void
+recv_sorted_values(StringInfo buf, int type, char *values, int nvalues)
+{
+	int				i;
+	uint64			prev = int64_to_key(0);
+	unsigned char  *ptr = (unsigned char *) buf->data + buf->cursor;
+	unsigned char  *end = (unsigned char *) buf->data + buf->len;
+
+	if (type == QUANTILE_TYPE_NUMERIC)
+	{
+		for (i = 0; i < nvalues; i++)
+			recv_element(buf, type, values + (Size) i * sizeof(Numeric));
+		return;
+	}
+
+	for (i = 0; i < nvalues; i++)
+	{
+		uint64	delta = 0;
+		int		shift = 0;
+
+		/* the common case - a single byte */
+		if ((ptr < end) && (*ptr < 0x80))
+			delta = *ptr++;
+		else
+		{
+			while (true)
+			{
+				if ((ptr == end) || (shift > 63))
+					elog(ERROR, "invalid varint in quantile state");
+
+				delta |= (uint64) (*ptr & 0x7F) << shift;
+				shift += 7;
+
+				if (*ptr++ < 0x80)
+					break;
+			}
+		}
+
+		prev += (delta >> 1) ^ (~(delta & 1) + 1);
+
+		switch (type)
+		{
+			case QUANTILE_TYPE_INT32:
+			{
+				int64	value = key_to_int64(prev);
+
+				if ((value < INT_MIN) || (value > INT_MAX))
+					elog(ERROR, "invalid int32 value in quantile state");
+
+				((int32 *) values)[i] = (int32) value;
+				break;
+			}
+
+			case QUANTILE_TYPE_INT64:
+				((int64 *) values)[i] = key_to_int64(prev);
+				break;
+
+			default:
+				((double *) values)[i] = key_to_double(prev);
+				break;
+		}
+	}
+
+	buf->cursor = (char *) ptr - buf->data;
+}
+
+/*
+ * Return all the values in the state as a single sorted array. Without
+ * any runs, that's just the sorted in-memory values. Otherwise we merge
+ * the runs (and the sorted in-memory values) using a binary heap of the
+ * first remaining value from each run.
+ */
+static char *
+state_sorted_values(quantile_state *state, int type, int *len)
+{
+	int		i,
+			r;
+	int		nruns = 0;
+	int		nheap;
+	Size	elsize = quantile_type_size(type);
+	int		(*cmp) (const void *a, const void *b) = quantile_type_comparator(type);
+	char  **runs;
+	int	   *lengths;
+	int	   *positions;
+	int	   *heap;
+	int64	total = 0;
+	char   *result;
+
+	Assert(state->spill == NULL);
+
+	quantile_sort(state->elements, state->nelements, type);
+
+	if (state->nruns == 0)
+	{
+		*len = state->nelements;
+		return (char *) state->elements;
+	}
+
+	runs = (char **) palloc(sizeof(char *) * (state->nruns + 1));
+	lengths = (int *) palloc(sizeof(int) * (state->nruns + 1));
+
+	for (r = 0; r < state->nruns; r++)
+	{
+		runs[nruns] = (char *) state->runs[r].elements;
+		lengths[nruns++] = state->runs[r].nelements;
+	}
+
+	if (state->nelements > 0)
+	{
+		runs[nruns] = (char *) state->elements;
+		lengths[nruns++] = state->nelements;
+	}
+
+	for (r = 0; r < nruns; r++)
+		total += lengths[r];
+
+	if (total > INT_MAX)
+		elog(ERROR, "too many values in the quantile state");
+
+	result = MemoryContextAllocHuge(CurrentMemoryContext, elsize * Max(total, 1));
+	positions = (int *) palloc0(sizeof(int) * nruns);
+	heap = (int *) palloc(sizeof(int) * nruns);
+
+	/* build the heap, with the first remaining value of each run */
+	nheap = 0;
+	for (r = 0; r < nruns; r++)
+		if (lengths[r] > 0)
+			heap[nheap++] = r;
+
+	for (i = nheap / 2 - 1; i >= 0; i--)
+		merge_sift_down(heap, nheap, i, runs, positions, elsize, cmp);
+
+	for (i = 0; i < total; i++)
+	{
+		r = heap[0];
+
+		memcpy(result + (Size) i * elsize, runs[r] + (Size) positions[r] * elsize,
+			   elsize);
+		positions[r]++;
+
+		/* remove exhausted runs, then restore the heap */
+		if (positions[r] == lengths[r])
+			heap[0] = heap[--nheap];
+
+		merge_sift_down(heap, nheap, 0, runs, positions, elsize, cmp);
+	}
+
+	*len = (int) total;
+
+	return result;
+}
+
+/*
+ * Sift a run down the binary heap used by state_sorted_values, comparing
+ * the first remaining values of the runs.
+ */
+static void
+merge_sift_down(int *heap, int nheap, int j, char **runs, int *positions,
+				Size elsize, int (*cmp) (const void *a, const void *b))
+{
+	while (true)
+	{
+		int		c = 2 * j + 1;
+		int		tmp;
+
+		if (c >= nheap)
+			break;
+
+		if ((c + 1 < nheap) &&
+			(cmp(runs[heap[c + 1]] + (Size) positions[heap[c + 1]] * elsize,
+				 runs[heap[c]] + (Size) positions[heap[c]] * elsize) < 0))
+			c++;
+
+		if (cmp(runs[heap[c]] + (Size) positions[heap[c]] * elsize,
+				runs[heap[j]] + (Size) positions[heap[j]] * elsize) >= 0)
+			break;
+
+		tmp = heap[c];
+		heap[c] = heap[j];
+		heap[j] = tmp;
+		j = c;
+	}
+}
+
+/*
+ * Encode sorted values as a storable state (the format version, data
+ * type and number of values, followed by the values).
+ */
+static bytea *
+stored_state_encode(int type, char *values, int nvalues)
+{
+	StringInfoData	buf;
+
+	pq_begintypsend(&buf);
+
+	pq_sendint32(&buf, QUANTILE_STATE_FORMAT);
+	pq_sendint32(&buf, type);
+	pq_sendint32(&buf, nvalues);
+
+	send_sorted_values(&buf, type, values, nvalues);
+
+	return pq_endtypsend(&buf);
+}
+
+/*
+ * Decode a storable state into an array of sorted values, allocated in the
+ * current memory context. The states may come from user input, so make
+ * sure the values really are sorted (and the numerics look sane).
+ */
+static char *
+stored_state_decode(bytea *stored, int type, int *len)
+{
+	int				i;
+	int				format;
+	Size			elsize = quantile_type_size(type);
+	int				(*cmp) (const void *a, const void *b) = quantile_type_comparator(type);
+	char		   *values;
+	StringInfoData	buf;
+
+	initStringInfo(&buf);
+	appendBinaryStringInfo(&buf, VARDATA_ANY(stored),
+						   VARSIZE_ANY_EXHDR(stored));
+
+	format = pq_getmsgint(&buf, 4);
+	if (format != QUANTILE_STATE_FORMAT)
+		elog(ERROR, "unsupported quantile state format %d", format);
+
+	if (pq_getmsgint(&buf, 4) != type)
+		elog(ERROR, "quantile state has unexpected data type");
+
+	/* each value needs at least one byte */
+	*len = pq_getmsgint(&buf, 4);
+	if ((*len < 0) || (*len > buf.len - buf.cursor))
+		elog(ERROR, "invalid number of values in quantile state");
+
+	values = MemoryContextAllocHuge(CurrentMemoryContext, elsize * Max(*len, 1));
+
+	/* numerics are not delta encoded, but check the lengths */
+	if (type == QUANTILE_TYPE_NUMERIC)
+	{
+		for (i = 0; i < *len; i++)
+			((Numeric *) values)[i] = recv_stored_numeric(&buf);
+	}
+	else
+		recv_sorted_values(&buf, type, values, *len);
+
+	for (i = 1; i < *len; i++)
+	{
+		char   *value = values + (Size) i * elsize;
+
+		if (cmp(value - elsize, value) > 0)
+			elog(ERROR, "values in quantile state are not sorted");
+	}
+
+	pq_getmsgend(&buf);
+	pfree(buf.data);
+
+	return values;
+}
+
+/*
+ * Read a numeric value from a storable state (or sketch), making sure the
+ * length is sane - the data may come from user input.
+ */
+static Numeric
+recv_stored_numeric(StringInfo buf)
+{
+	int		nlen = pq_getmsgint(buf, 4);
+	Numeric	num;
+
+	if ((nlen < (int) (VARHDRSZ + sizeof(uint16))) ||
+		(nlen > buf->len - buf->cursor))
+		elog(ERROR, "invalid numeric value in quantile state");
+
+	num = (Numeric) palloc(nlen);
+	pq_copymsgbytes(buf, (char *) num, nlen);
+
+	if (VARSIZE(num) != nlen)
+		elog(ERROR, "invalid numeric value in quantile state");
+
+	return num;
+}
+
+/*
+ * Encode a Greenwald-Khanna summary as a storable sketch (the format
+ * version, data type, epsilon, number of values and of tuples, followed
+ * by the sorted tuple values and the g/delta of each tuple).
+ */
+static bytea *
+sketch_encode(quantile_eps_state *state)
+{
+	int				i;
+	StringInfoData	buf;
+
+	eps_state_flush(state);
+
+	pq_begintypsend(&buf);
+
+	pq_sendint32(&buf, QUANTILE_SKETCH_FORMAT);
+	pq_sendint32(&buf, state->type);
+	pq_sendfloat8(&buf, state->epsilon);
+	pq_sendint64(&buf, state->count);
+	pq_sendint32(&buf, state->ntuples);
+
+	send_sorted_values(&buf, state->type, (char *) state->values,
+					   state->ntuples);
+
+	for (i = 0; i < state->ntuples; i++)
+	{
+		pq_sendint64(&buf, state->tuples[i].g);
+		pq_sendint64(&buf, state->tuples[i].delta);
+	}
+
+	return pq_endtypsend(&buf);
+}
+
+/*
+ * Decode a storable sketch into a Greenwald-Khanna summary (without any
+ * quantiles), allocated in the current memory context. The sketch may
+ * come from user input, so make sure it's consistent.
+ */
+static quantile_eps_state *
+sketch_decode(bytea *sketch, int type)
+{
+	int				i;
+	int				ntuples;
+	int64			count = 0;
+	Size			elsize = quantile_type_size(type);
+	int				(*cmp) (const void *a, const void *b) = quantile_type_comparator(type);
+	quantile_eps_state *state;
+	StringInfoData	buf;
+
+	initStringInfo(&buf);
+	appendBinaryStringInfo(&buf, VARDATA_ANY(sketch),
+						   VARSIZE_ANY_EXHDR(sketch));
+
+	if (pq_getmsgint(&buf, 4) != QUANTILE_SKETCH_FORMAT)
+		elog(ERROR, "unsupported quantile sketch format");
+
+	if (pq_getmsgint(&buf, 4) != type)
+		elog(ERROR, "quantile sketch has unexpected data type");
+
+	state = eps_state_alloc(type, pq_getmsgfloat8(&buf));
+
+	state->count = pq_getmsgint64(&buf);
+
+	/* each tuple needs at least 17 bytes (value, g and delta) */
+	ntuples = pq_getmsgint(&buf, 4);
+	if ((ntuples < 0) || (ntuples > (buf.len - buf.cursor) / 17))
+		elog(ERROR, "invalid number of tuples in quantile sketch");
+
+	eps_state_reserve(state, ntuples);
+
+	if (type == QUANTILE_TYPE_NUMERIC)
+	{
+		for (i = 0; i < ntuples; i++)
+			((Numeric *) state->values)[i] = recv_stored_numeric(&buf);
+	}
+	else
+		recv_sorted_values(&buf, type, (char *) state->values, ntuples);
+
+	state->ntuples = ntuples;
+
+	for (i = 0; i < ntuples; i++)
+	{
+		char   *value = (char *) state->values + (Size) i * elsize;
+
+		state->tuples[i].g = pq_getmsgint64(&buf);
+		state->tuples[i].delta = pq_getmsgint64(&buf);
+
+		if ((state->tuples[i].g < 0) || (state->tuples[i].delta < 0))
+			elog(ERROR, "invalid tuple in quantile sketch");
+
+		if ((i > 0) && (cmp(value - elsize, value) > 0))
+			elog(ERROR, "values in quantile sketch are not sorted");
+
+		count += state->tuples[i].g;
+	}
+
+	if (count != state->count)
+		elog(ERROR, "invalid number of values in quantile sketch");
+
+	pq_getmsgend(&buf);
+	pfree(buf.data);
+
+	return state;
+}
+
+/*
+ * Convert the (sorted) values to doubles, for computing the robust
+ * statistics. Arrays of doubles are returned as is.
+ */
+static double *
+values_to_double(char *values, int nvalues, int type)
+{
+	int			i;
+	double	   *result;
+
+	if (type == QUANTILE_TYPE_DOUBLE)
+		return (double *) values;
+
+	result = (double *) MemoryContextAllocHuge(CurrentMemoryContext,
+											   sizeof(double) * Max(nvalues, 1));
+
+	for (i = 0; i < nvalues; i++)
+	{
+		switch (type)
+		{
+			case QUANTILE_TYPE_INT32:
+				result[i] = ((int32 *) values)[i];
+				break;
+
+			case QUANTILE_TYPE_INT64:
+				result[i] = (double) ((int64 *) values)[i];
+				break;
+
+			case QUANTILE_TYPE_NUMERIC:
+				result[i] = DatumGetFloat8(DirectFunctionCall1(numeric_float8,
+															   NumericGetDatum(((Numeric *) values)[i])));
+				break;
+
+			default:
+				elog(ERROR, "unknown data type %d", type);
+		}
+	}
+
+	return result;
 }
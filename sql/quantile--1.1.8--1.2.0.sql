@@ -0,0 +1,1495 @@
+/* approximate quantiles with a guaranteed rank error (Greenwald-Khanna) */
+CREATE OR REPLACE FUNCTION quantile_eps_combine(p_pointer internal, p_pointer2 internal)
+    RETURNS internal
+    AS 'quantile', 'quantile_eps_combine'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_eps_serialize(p_pointer internal)
+    RETURNS bytea
+    AS 'quantile', 'quantile_eps_serialize'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_eps_deserialize(p_value bytea, p_pointer internal)
+    RETURNS internal
+    AS 'quantile', 'quantile_eps_deserialize'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_eps_append_double(p_pointer internal, p_element double precision, p_quantiles double precision[], p_epsilon double precision)
+    RETURNS internal
+    AS 'quantile', 'quantile_eps_append_double'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_eps_double(p_pointer internal)
+    RETURNS double precision[]
+    AS 'quantile', 'quantile_eps_double'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_eps(double precision, double precision[], double precision) (
+    SFUNC = quantile_eps_append_double,
+    STYPE = internal,
+    FINALFUNC = quantile_eps_double,
+    COMBINEFUNC = quantile_eps_combine,
+    SERIALFUNC = quantile_eps_serialize,
+    DESERIALFUNC = quantile_eps_deserialize,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION quantile_eps_append_numeric(p_pointer internal, p_element numeric, p_quantiles double precision[], p_epsilon double precision)
+    RETURNS internal
+    AS 'quantile', 'quantile_eps_append_numeric'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_eps_numeric(p_pointer internal)
+    RETURNS numeric[]
+    AS 'quantile', 'quantile_eps_numeric'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_eps(numeric, double precision[], double precision) (
+    SFUNC = quantile_eps_append_numeric,
+    STYPE = internal,
+    FINALFUNC = quantile_eps_numeric,
+    COMBINEFUNC = quantile_eps_combine,
+    SERIALFUNC = quantile_eps_serialize,
+    DESERIALFUNC = quantile_eps_deserialize,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION quantile_eps_append_int32(p_pointer internal, p_element int, p_quantiles double precision[], p_epsilon double precision)
+    RETURNS internal
+    AS 'quantile', 'quantile_eps_append_int32'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_eps_int32(p_pointer internal)
+    RETURNS int[]
+    AS 'quantile', 'quantile_eps_int32'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_eps(int, double precision[], double precision) (
+    SFUNC = quantile_eps_append_int32,
+    STYPE = internal,
+    FINALFUNC = quantile_eps_int32,
+    COMBINEFUNC = quantile_eps_combine,
+    SERIALFUNC = quantile_eps_serialize,
+    DESERIALFUNC = quantile_eps_deserialize,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION quantile_eps_append_int64(p_pointer internal, p_element bigint, p_quantiles double precision[], p_epsilon double precision)
+    RETURNS internal
+    AS 'quantile', 'quantile_eps_append_int64'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_eps_int64(p_pointer internal)
+    RETURNS bigint[]
+    AS 'quantile', 'quantile_eps_int64'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_eps(bigint, double precision[], double precision) (
+    SFUNC = quantile_eps_append_int64,
+    STYPE = internal,
+    FINALFUNC = quantile_eps_int64,
+    COMBINEFUNC = quantile_eps_combine,
+    SERIALFUNC = quantile_eps_serialize,
+    DESERIALFUNC = quantile_eps_deserialize,
+    PARALLEL = SAFE
+);
+
+/* rank (CDF) aggregates, optionally combined with quantiles */
+CREATE TYPE quantile_and_rank_double_result AS (quantiles double precision[], ranks double precision[]);
+
+CREATE OR REPLACE FUNCTION quantile_rank_append_double(p_pointer internal, p_element double precision, p_thresholds double precision[])
+    RETURNS internal
+    AS 'quantile', 'quantile_rank_append_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION quantile_rank_double(p_pointer internal)
+    RETURNS double precision[]
+    AS 'quantile', 'quantile_rank_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION quantile_and_rank_append_double(p_pointer internal, p_element double precision, p_quantiles double precision[], p_thresholds double precision[])
+    RETURNS internal
+    AS 'quantile', 'quantile_and_rank_append_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION quantile_and_rank_double(p_pointer internal)
+    RETURNS quantile_and_rank_double_result
+    AS 'quantile', 'quantile_and_rank_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE quantile_rank(double precision, double precision[]) (
+    SFUNC = quantile_rank_append_double,
+    STYPE = internal,
+    FINALFUNC = quantile_rank_double
+);
+
+CREATE AGGREGATE quantile_and_rank(double precision, double precision[], double precision[]) (
+    SFUNC = quantile_and_rank_append_double,
+    STYPE = internal,
+    FINALFUNC = quantile_and_rank_double
+);
+
+CREATE TYPE quantile_and_rank_numeric_result AS (quantiles numeric[], ranks double precision[]);
+
+CREATE OR REPLACE FUNCTION quantile_rank_append_numeric(p_pointer internal, p_element numeric, p_thresholds numeric[])
+    RETURNS internal
+    AS 'quantile', 'quantile_rank_append_numeric'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION quantile_rank_numeric(p_pointer internal)
+    RETURNS double precision[]
+    AS 'quantile', 'quantile_rank_numeric'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION quantile_and_rank_append_numeric(p_pointer internal, p_element numeric, p_quantiles double precision[], p_thresholds numeric[])
+    RETURNS internal
+    AS 'quantile', 'quantile_and_rank_append_numeric'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION quantile_and_rank_numeric(p_pointer internal)
+    RETURNS quantile_and_rank_numeric_result
+    AS 'quantile', 'quantile_and_rank_numeric'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE quantile_rank(numeric, numeric[]) (
+    SFUNC = quantile_rank_append_numeric,
+    STYPE = internal,
+    FINALFUNC = quantile_rank_numeric
+);
+
+CREATE AGGREGATE quantile_and_rank(numeric, double precision[], numeric[]) (
+    SFUNC = quantile_and_rank_append_numeric,
+    STYPE = internal,
+    FINALFUNC = quantile_and_rank_numeric
+);
+
+CREATE TYPE quantile_and_rank_int32_result AS (quantiles int[], ranks double precision[]);
+
+CREATE OR REPLACE FUNCTION quantile_rank_append_int32(p_pointer internal, p_element int, p_thresholds int[])
+    RETURNS internal
+    AS 'quantile', 'quantile_rank_append_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION quantile_rank_int32(p_pointer internal)
+    RETURNS double precision[]
+    AS 'quantile', 'quantile_rank_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION quantile_and_rank_append_int32(p_pointer internal, p_element int, p_quantiles double precision[], p_thresholds int[])
+    RETURNS internal
+    AS 'quantile', 'quantile_and_rank_append_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION quantile_and_rank_int32(p_pointer internal)
+    RETURNS quantile_and_rank_int32_result
+    AS 'quantile', 'quantile_and_rank_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE quantile_rank(int, int[]) (
+    SFUNC = quantile_rank_append_int32,
+    STYPE = internal,
+    FINALFUNC = quantile_rank_int32
+);
+
+CREATE AGGREGATE quantile_and_rank(int, double precision[], int[]) (
+    SFUNC = quantile_and_rank_append_int32,
+    STYPE = internal,
+    FINALFUNC = quantile_and_rank_int32
+);
+
+CREATE TYPE quantile_and_rank_int64_result AS (quantiles bigint[], ranks double precision[]);
+
+CREATE OR REPLACE FUNCTION quantile_rank_append_int64(p_pointer internal, p_element bigint, p_thresholds bigint[])
+    RETURNS internal
+    AS 'quantile', 'quantile_rank_append_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION quantile_rank_int64(p_pointer internal)
+    RETURNS double precision[]
+    AS 'quantile', 'quantile_rank_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION quantile_and_rank_append_int64(p_pointer internal, p_element bigint, p_quantiles double precision[], p_thresholds bigint[])
+    RETURNS internal
+    AS 'quantile', 'quantile_and_rank_append_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION quantile_and_rank_int64(p_pointer internal)
+    RETURNS quantile_and_rank_int64_result
+    AS 'quantile', 'quantile_and_rank_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE quantile_rank(bigint, bigint[]) (
+    SFUNC = quantile_rank_append_int64,
+    STYPE = internal,
+    FINALFUNC = quantile_rank_int64
+);
+
+CREATE AGGREGATE quantile_and_rank(bigint, double precision[], bigint[]) (
+    SFUNC = quantile_and_rank_append_int64,
+    STYPE = internal,
+    FINALFUNC = quantile_and_rank_int64
+);
+
+/* equi-depth histograms (bucket boundaries and counts) */
+CREATE TYPE quantile_buckets_double_result AS (boundaries double precision[], counts bigint[]);
+
+CREATE OR REPLACE FUNCTION quantile_buckets_append_double(p_pointer internal, p_element double precision, p_buckets int)
+    RETURNS internal
+    AS 'quantile', 'quantile_buckets_append_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION quantile_buckets_double(p_pointer internal)
+    RETURNS quantile_buckets_double_result
+    AS 'quantile', 'quantile_buckets_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE quantile_buckets(double precision, int) (
+    SFUNC = quantile_buckets_append_double,
+    STYPE = internal,
+    FINALFUNC = quantile_buckets_double
+);
+
+CREATE TYPE quantile_buckets_numeric_result AS (boundaries numeric[], counts bigint[]);
+
+CREATE OR REPLACE FUNCTION quantile_buckets_append_numeric(p_pointer internal, p_element numeric, p_buckets int)
+    RETURNS internal
+    AS 'quantile', 'quantile_buckets_append_numeric'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION quantile_buckets_numeric(p_pointer internal)
+    RETURNS quantile_buckets_numeric_result
+    AS 'quantile', 'quantile_buckets_numeric'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE quantile_buckets(numeric, int) (
+    SFUNC = quantile_buckets_append_numeric,
+    STYPE = internal,
+    FINALFUNC = quantile_buckets_numeric
+);
+
+CREATE TYPE quantile_buckets_int32_result AS (boundaries int[], counts bigint[]);
+
+CREATE OR REPLACE FUNCTION quantile_buckets_append_int32(p_pointer internal, p_element int, p_buckets int)
+    RETURNS internal
+    AS 'quantile', 'quantile_buckets_append_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION quantile_buckets_int32(p_pointer internal)
+    RETURNS quantile_buckets_int32_result
+    AS 'quantile', 'quantile_buckets_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE quantile_buckets(int, int) (
+    SFUNC = quantile_buckets_append_int32,
+    STYPE = internal,
+    FINALFUNC = quantile_buckets_int32
+);
+
+CREATE TYPE quantile_buckets_int64_result AS (boundaries bigint[], counts bigint[]);
+
+CREATE OR REPLACE FUNCTION quantile_buckets_append_int64(p_pointer internal, p_element bigint, p_buckets int)
+    RETURNS internal
+    AS 'quantile', 'quantile_buckets_append_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION quantile_buckets_int64(p_pointer internal)
+    RETURNS quantile_buckets_int64_result
+    AS 'quantile', 'quantile_buckets_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE quantile_buckets(bigint, int) (
+    SFUNC = quantile_buckets_append_int64,
+    STYPE = internal,
+    FINALFUNC = quantile_buckets_int64
+);
+
+/* approximate quantiles from a random sample (reservoir sampling) */
+CREATE TYPE quantile_sampled_double_result AS (quantiles double precision[], sample_count bigint, total_count bigint);
+
+CREATE OR REPLACE FUNCTION quantile_sampled_append_double(p_pointer internal, p_element double precision, p_quantiles double precision[], p_sample_size int)
+    RETURNS internal
+    AS 'quantile', 'quantile_sampled_append_double'
+    LANGUAGE C VOLATILE;
+
+CREATE OR REPLACE FUNCTION quantile_sampled_double(p_pointer internal)
+    RETURNS quantile_sampled_double_result
+    AS 'quantile', 'quantile_sampled_double'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE quantile_sampled(double precision, double precision[], int) (
+    SFUNC = quantile_sampled_append_double,
+    STYPE = internal,
+    FINALFUNC = quantile_sampled_double
+);
+
+CREATE TYPE quantile_sampled_numeric_result AS (quantiles numeric[], sample_count bigint, total_count bigint);
+
+CREATE OR REPLACE FUNCTION quantile_sampled_append_numeric(p_pointer internal, p_element numeric, p_quantiles double precision[], p_sample_size int)
+    RETURNS internal
+    AS 'quantile', 'quantile_sampled_append_numeric'
+    LANGUAGE C VOLATILE;
+
+CREATE OR REPLACE FUNCTION quantile_sampled_numeric(p_pointer internal)
+    RETURNS quantile_sampled_numeric_result
+    AS 'quantile', 'quantile_sampled_numeric'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE quantile_sampled(numeric, double precision[], int) (
+    SFUNC = quantile_sampled_append_numeric,
+    STYPE = internal,
+    FINALFUNC = quantile_sampled_numeric
+);
+
+CREATE TYPE quantile_sampled_int32_result AS (quantiles int[], sample_count bigint, total_count bigint);
+
+CREATE OR REPLACE FUNCTION quantile_sampled_append_int32(p_pointer internal, p_element int, p_quantiles double precision[], p_sample_size int)
+    RETURNS internal
+    AS 'quantile', 'quantile_sampled_append_int32'
+    LANGUAGE C VOLATILE;
+
+CREATE OR REPLACE FUNCTION quantile_sampled_int32(p_pointer internal)
+    RETURNS quantile_sampled_int32_result
+    AS 'quantile', 'quantile_sampled_int32'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE quantile_sampled(int, double precision[], int) (
+    SFUNC = quantile_sampled_append_int32,
+    STYPE = internal,
+    FINALFUNC = quantile_sampled_int32
+);
+
+CREATE TYPE quantile_sampled_int64_result AS (quantiles bigint[], sample_count bigint, total_count bigint);
+
+CREATE OR REPLACE FUNCTION quantile_sampled_append_int64(p_pointer internal, p_element bigint, p_quantiles double precision[], p_sample_size int)
+    RETURNS internal
+    AS 'quantile', 'quantile_sampled_append_int64'
+    LANGUAGE C VOLATILE;
+
+CREATE OR REPLACE FUNCTION quantile_sampled_int64(p_pointer internal)
+    RETURNS quantile_sampled_int64_result
+    AS 'quantile', 'quantile_sampled_int64'
+    LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE quantile_sampled(bigint, double precision[], int) (
+    SFUNC = quantile_sampled_append_int64,
+    STYPE = internal,
+    FINALFUNC = quantile_sampled_int64
+);
+
+/* parallel aggregation for the quantile aggregates */
+ALTER FUNCTION quantile_append_double(internal, double precision, double precision) PARALLEL SAFE;
+ALTER FUNCTION quantile_append_double_array(internal, double precision, double precision[]) PARALLEL SAFE;
+ALTER FUNCTION quantile_double(internal) PARALLEL SAFE;
+ALTER FUNCTION quantile_double_array(internal) PARALLEL SAFE;
+
+ALTER FUNCTION quantile_append_numeric(internal, numeric, double precision) PARALLEL SAFE;
+ALTER FUNCTION quantile_append_numeric_array(internal, numeric, double precision[]) PARALLEL SAFE;
+ALTER FUNCTION quantile_numeric(internal) PARALLEL SAFE;
+ALTER FUNCTION quantile_numeric_array(internal) PARALLEL SAFE;
+
+ALTER FUNCTION quantile_append_int32(internal, int, double precision) PARALLEL SAFE;
+ALTER FUNCTION quantile_append_int32_array(internal, int, double precision[]) PARALLEL SAFE;
+ALTER FUNCTION quantile_int32(internal) PARALLEL SAFE;
+ALTER FUNCTION quantile_int32_array(internal) PARALLEL SAFE;
+
+ALTER FUNCTION quantile_append_int64(internal, bigint, double precision) PARALLEL SAFE;
+ALTER FUNCTION quantile_append_int64_array(internal, bigint, double precision[]) PARALLEL SAFE;
+ALTER FUNCTION quantile_int64(internal) PARALLEL SAFE;
+ALTER FUNCTION quantile_int64_array(internal) PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_combine_double(p_pointer internal, p_pointer2 internal)
+    RETURNS internal
+    AS 'quantile', 'quantile_combine_double'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_serialize_double(p_pointer internal)
+    RETURNS bytea
+    AS 'quantile', 'quantile_serialize_double'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_deserialize_double(p_value bytea, p_pointer internal)
+    RETURNS internal
+    AS 'quantile', 'quantile_deserialize_double'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_combine_numeric(p_pointer internal, p_pointer2 internal)
+    RETURNS internal
+    AS 'quantile', 'quantile_combine_numeric'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_serialize_numeric(p_pointer internal)
+    RETURNS bytea
+    AS 'quantile', 'quantile_serialize_numeric'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_deserialize_numeric(p_value bytea, p_pointer internal)
+    RETURNS internal
+    AS 'quantile', 'quantile_deserialize_numeric'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_combine_int32(p_pointer internal, p_pointer2 internal)
+    RETURNS internal
+    AS 'quantile', 'quantile_combine_int32'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_serialize_int32(p_pointer internal)
+    RETURNS bytea
+    AS 'quantile', 'quantile_serialize_int32'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_deserialize_int32(p_value bytea, p_pointer internal)
+    RETURNS internal
+    AS 'quantile', 'quantile_deserialize_int32'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_combine_int64(p_pointer internal, p_pointer2 internal)
+    RETURNS internal
+    AS 'quantile', 'quantile_combine_int64'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_serialize_int64(p_pointer internal)
+    RETURNS bytea
+    AS 'quantile', 'quantile_serialize_int64'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_deserialize_int64(p_value bytea, p_pointer internal)
+    RETURNS internal
+    AS 'quantile', 'quantile_deserialize_int64'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+/* there is no ALTER AGGREGATE for this, so update the catalogs directly */
+UPDATE pg_catalog.pg_aggregate
+   SET aggcombinefn = 'quantile_combine_double'::regproc,
+       aggserialfn = 'quantile_serialize_double'::regproc,
+       aggdeserialfn = 'quantile_deserialize_double'::regproc
+ WHERE aggfnoid IN ('quantile(double precision, double precision)'::regprocedure,
+                    'quantile(double precision, double precision[])'::regprocedure);
+
+UPDATE pg_catalog.pg_aggregate
+   SET aggcombinefn = 'quantile_combine_numeric'::regproc,
+       aggserialfn = 'quantile_serialize_numeric'::regproc,
+       aggdeserialfn = 'quantile_deserialize_numeric'::regproc
+ WHERE aggfnoid IN ('quantile(numeric, double precision)'::regprocedure,
+                    'quantile(numeric, double precision[])'::regprocedure);
+
+UPDATE pg_catalog.pg_aggregate
+   SET aggcombinefn = 'quantile_combine_int32'::regproc,
+       aggserialfn = 'quantile_serialize_int32'::regproc,
+       aggdeserialfn = 'quantile_deserialize_int32'::regproc
+ WHERE aggfnoid IN ('quantile(int, double precision)'::regprocedure,
+                    'quantile(int, double precision[])'::regprocedure);
+
+UPDATE pg_catalog.pg_aggregate
+   SET aggcombinefn = 'quantile_combine_int64'::regproc,
+       aggserialfn = 'quantile_serialize_int64'::regproc,
+       aggdeserialfn = 'quantile_deserialize_int64'::regproc
+ WHERE aggfnoid IN ('quantile(bigint, double precision)'::regprocedure,
+                    'quantile(bigint, double precision[])'::regprocedure);
+
+UPDATE pg_catalog.pg_proc SET proparallel = 's'
+ WHERE oid IN ('quantile(double precision, double precision)'::regprocedure,
+               'quantile(double precision, double precision[])'::regprocedure,
+               'quantile(numeric, double precision)'::regprocedure,
+               'quantile(numeric, double precision[])'::regprocedure,
+               'quantile(int, double precision)'::regprocedure,
+               'quantile(int, double precision[])'::regprocedure,
+               'quantile(bigint, double precision)'::regprocedure,
+               'quantile(bigint, double precision[])'::regprocedure);
+
+/* quantiles of array values (whole arrays appended at once) */
+CREATE OR REPLACE FUNCTION quantile_array_agg_append_double(p_pointer internal, p_elements double precision[], p_quantiles double precision[])
+    RETURNS internal
+    AS 'quantile', 'quantile_array_agg_append_double'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_array_agg(double precision[], double precision[]) (
+    SFUNC = quantile_array_agg_append_double,
+    STYPE = internal,
+    FINALFUNC = quantile_double_array,
+    COMBINEFUNC = quantile_combine_double,
+    SERIALFUNC = quantile_serialize_double,
+    DESERIALFUNC = quantile_deserialize_double,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION array_quantile(p_elements double precision[], p_quantiles double precision[])
+    RETURNS double precision[]
+    AS 'quantile', 'array_quantile_double'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_array_agg_append_int32(p_pointer internal, p_elements int[], p_quantiles double precision[])
+    RETURNS internal
+    AS 'quantile', 'quantile_array_agg_append_int32'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_array_agg(int[], double precision[]) (
+    SFUNC = quantile_array_agg_append_int32,
+    STYPE = internal,
+    FINALFUNC = quantile_int32_array,
+    COMBINEFUNC = quantile_combine_int32,
+    SERIALFUNC = quantile_serialize_int32,
+    DESERIALFUNC = quantile_deserialize_int32,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION array_quantile(p_elements int[], p_quantiles double precision[])
+    RETURNS int[]
+    AS 'quantile', 'array_quantile_int32'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_array_agg_append_int64(p_pointer internal, p_elements bigint[], p_quantiles double precision[])
+    RETURNS internal
+    AS 'quantile', 'quantile_array_agg_append_int64'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_array_agg(bigint[], double precision[]) (
+    SFUNC = quantile_array_agg_append_int64,
+    STYPE = internal,
+    FINALFUNC = quantile_int64_array,
+    COMBINEFUNC = quantile_combine_int64,
+    SERIALFUNC = quantile_serialize_int64,
+    DESERIALFUNC = quantile_deserialize_int64,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION array_quantile(p_elements bigint[], p_quantiles double precision[])
+    RETURNS bigint[]
+    AS 'quantile', 'array_quantile_int64'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+/* storable states, merged into higher-level states or quantiles (rollups) */
+CREATE TYPE quantile_state_double;
+
+CREATE OR REPLACE FUNCTION quantile_state_double_in(cstring)
+    RETURNS quantile_state_double
+    AS 'byteain'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_state_double_out(quantile_state_double)
+    RETURNS cstring
+    AS 'byteaout'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_state_double_recv(internal)
+    RETURNS quantile_state_double
+    AS 'bytearecv'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_state_double_send(quantile_state_double)
+    RETURNS bytea
+    AS 'byteasend'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE TYPE quantile_state_double (
+    INPUT = quantile_state_double_in,
+    OUTPUT = quantile_state_double_out,
+    RECEIVE = quantile_state_double_recv,
+    SEND = quantile_state_double_send,
+    INTERNALLENGTH = VARIABLE,
+    STORAGE = extended
+);
+
+CREATE OR REPLACE FUNCTION quantile_state_agg_append_double(p_pointer internal, p_element double precision)
+    RETURNS internal
+    AS 'quantile', 'quantile_state_agg_append_double'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_state_agg_double(p_pointer internal)
+    RETURNS quantile_state_double
+    AS 'quantile', 'quantile_state_agg_double'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_state_agg(double precision) (
+    SFUNC = quantile_state_agg_append_double,
+    STYPE = internal,
+    FINALFUNC = quantile_state_agg_double,
+    COMBINEFUNC = quantile_combine_double,
+    SERIALFUNC = quantile_serialize_double,
+    DESERIALFUNC = quantile_deserialize_double,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION quantile_merge_append_double(p_pointer internal, p_state quantile_state_double)
+    RETURNS internal
+    AS 'quantile', 'quantile_merge_append_double'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_merge_append_double(p_pointer internal, p_state quantile_state_double, p_quantiles double precision[])
+    RETURNS internal
+    AS 'quantile', 'quantile_merge_append_double'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_merge(quantile_state_double) (
+    SFUNC = quantile_merge_append_double,
+    STYPE = internal,
+    FINALFUNC = quantile_state_agg_double,
+    COMBINEFUNC = quantile_combine_double,
+    SERIALFUNC = quantile_serialize_double,
+    DESERIALFUNC = quantile_deserialize_double,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE quantile_merge(quantile_state_double, double precision[]) (
+    SFUNC = quantile_merge_append_double,
+    STYPE = internal,
+    FINALFUNC = quantile_double_array,
+    COMBINEFUNC = quantile_combine_double,
+    SERIALFUNC = quantile_serialize_double,
+    DESERIALFUNC = quantile_deserialize_double,
+    PARALLEL = SAFE
+);
+
+CREATE TYPE quantile_state_numeric;
+
+CREATE OR REPLACE FUNCTION quantile_state_numeric_in(cstring)
+    RETURNS quantile_state_numeric
+    AS 'byteain'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_state_numeric_out(quantile_state_numeric)
+    RETURNS cstring
+    AS 'byteaout'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_state_numeric_recv(internal)
+    RETURNS quantile_state_numeric
+    AS 'bytearecv'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_state_numeric_send(quantile_state_numeric)
+    RETURNS bytea
+    AS 'byteasend'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE TYPE quantile_state_numeric (
+    INPUT = quantile_state_numeric_in,
+    OUTPUT = quantile_state_numeric_out,
+    RECEIVE = quantile_state_numeric_recv,
+    SEND = quantile_state_numeric_send,
+    INTERNALLENGTH = VARIABLE,
+    STORAGE = extended
+);
+
+CREATE OR REPLACE FUNCTION quantile_state_agg_append_numeric(p_pointer internal, p_element numeric)
+    RETURNS internal
+    AS 'quantile', 'quantile_state_agg_append_numeric'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_state_agg_numeric(p_pointer internal)
+    RETURNS quantile_state_numeric
+    AS 'quantile', 'quantile_state_agg_numeric'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_state_agg(numeric) (
+    SFUNC = quantile_state_agg_append_numeric,
+    STYPE = internal,
+    FINALFUNC = quantile_state_agg_numeric,
+    COMBINEFUNC = quantile_combine_numeric,
+    SERIALFUNC = quantile_serialize_numeric,
+    DESERIALFUNC = quantile_deserialize_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION quantile_merge_append_numeric(p_pointer internal, p_state quantile_state_numeric)
+    RETURNS internal
+    AS 'quantile', 'quantile_merge_append_numeric'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_merge_append_numeric(p_pointer internal, p_state quantile_state_numeric, p_quantiles double precision[])
+    RETURNS internal
+    AS 'quantile', 'quantile_merge_append_numeric'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_merge(quantile_state_numeric) (
+    SFUNC = quantile_merge_append_numeric,
+    STYPE = internal,
+    FINALFUNC = quantile_state_agg_numeric,
+    COMBINEFUNC = quantile_combine_numeric,
+    SERIALFUNC = quantile_serialize_numeric,
+    DESERIALFUNC = quantile_deserialize_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE quantile_merge(quantile_state_numeric, double precision[]) (
+    SFUNC = quantile_merge_append_numeric,
+    STYPE = internal,
+    FINALFUNC = quantile_numeric_array,
+    COMBINEFUNC = quantile_combine_numeric,
+    SERIALFUNC = quantile_serialize_numeric,
+    DESERIALFUNC = quantile_deserialize_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE TYPE quantile_state_int32;
+
+CREATE OR REPLACE FUNCTION quantile_state_int32_in(cstring)
+    RETURNS quantile_state_int32
+    AS 'byteain'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_state_int32_out(quantile_state_int32)
+    RETURNS cstring
+    AS 'byteaout'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_state_int32_recv(internal)
+    RETURNS quantile_state_int32
+    AS 'bytearecv'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_state_int32_send(quantile_state_int32)
+    RETURNS bytea
+    AS 'byteasend'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE TYPE quantile_state_int32 (
+    INPUT = quantile_state_int32_in,
+    OUTPUT = quantile_state_int32_out,
+    RECEIVE = quantile_state_int32_recv,
+    SEND = quantile_state_int32_send,
+    INTERNALLENGTH = VARIABLE,
+    STORAGE = extended
+);
+
+CREATE OR REPLACE FUNCTION quantile_state_agg_append_int32(p_pointer internal, p_element int)
+    RETURNS internal
+    AS 'quantile', 'quantile_state_agg_append_int32'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_state_agg_int32(p_pointer internal)
+    RETURNS quantile_state_int32
+    AS 'quantile', 'quantile_state_agg_int32'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_state_agg(int) (
+    SFUNC = quantile_state_agg_append_int32,
+    STYPE = internal,
+    FINALFUNC = quantile_state_agg_int32,
+    COMBINEFUNC = quantile_combine_int32,
+    SERIALFUNC = quantile_serialize_int32,
+    DESERIALFUNC = quantile_deserialize_int32,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION quantile_merge_append_int32(p_pointer internal, p_state quantile_state_int32)
+    RETURNS internal
+    AS 'quantile', 'quantile_merge_append_int32'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_merge_append_int32(p_pointer internal, p_state quantile_state_int32, p_quantiles double precision[])
+    RETURNS internal
+    AS 'quantile', 'quantile_merge_append_int32'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_merge(quantile_state_int32) (
+    SFUNC = quantile_merge_append_int32,
+    STYPE = internal,
+    FINALFUNC = quantile_state_agg_int32,
+    COMBINEFUNC = quantile_combine_int32,
+    SERIALFUNC = quantile_serialize_int32,
+    DESERIALFUNC = quantile_deserialize_int32,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE quantile_merge(quantile_state_int32, double precision[]) (
+    SFUNC = quantile_merge_append_int32,
+    STYPE = internal,
+    FINALFUNC = quantile_int32_array,
+    COMBINEFUNC = quantile_combine_int32,
+    SERIALFUNC = quantile_serialize_int32,
+    DESERIALFUNC = quantile_deserialize_int32,
+    PARALLEL = SAFE
+);
+
+CREATE TYPE quantile_state_int64;
+
+CREATE OR REPLACE FUNCTION quantile_state_int64_in(cstring)
+    RETURNS quantile_state_int64
+    AS 'byteain'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_state_int64_out(quantile_state_int64)
+    RETURNS cstring
+    AS 'byteaout'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_state_int64_recv(internal)
+    RETURNS quantile_state_int64
+    AS 'bytearecv'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_state_int64_send(quantile_state_int64)
+    RETURNS bytea
+    AS 'byteasend'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE TYPE quantile_state_int64 (
+    INPUT = quantile_state_int64_in,
+    OUTPUT = quantile_state_int64_out,
+    RECEIVE = quantile_state_int64_recv,
+    SEND = quantile_state_int64_send,
+    INTERNALLENGTH = VARIABLE,
+    STORAGE = extended
+);
+
+CREATE OR REPLACE FUNCTION quantile_state_agg_append_int64(p_pointer internal, p_element bigint)
+    RETURNS internal
+    AS 'quantile', 'quantile_state_agg_append_int64'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_state_agg_int64(p_pointer internal)
+    RETURNS quantile_state_int64
+    AS 'quantile', 'quantile_state_agg_int64'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_state_agg(bigint) (
+    SFUNC = quantile_state_agg_append_int64,
+    STYPE = internal,
+    FINALFUNC = quantile_state_agg_int64,
+    COMBINEFUNC = quantile_combine_int64,
+    SERIALFUNC = quantile_serialize_int64,
+    DESERIALFUNC = quantile_deserialize_int64,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION quantile_merge_append_int64(p_pointer internal, p_state quantile_state_int64)
+    RETURNS internal
+    AS 'quantile', 'quantile_merge_append_int64'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_merge_append_int64(p_pointer internal, p_state quantile_state_int64, p_quantiles double precision[])
+    RETURNS internal
+    AS 'quantile', 'quantile_merge_append_int64'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_merge(quantile_state_int64) (
+    SFUNC = quantile_merge_append_int64,
+    STYPE = internal,
+    FINALFUNC = quantile_state_agg_int64,
+    COMBINEFUNC = quantile_combine_int64,
+    SERIALFUNC = quantile_serialize_int64,
+    DESERIALFUNC = quantile_deserialize_int64,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE quantile_merge(quantile_state_int64, double precision[]) (
+    SFUNC = quantile_merge_append_int64,
+    STYPE = internal,
+    FINALFUNC = quantile_int64_array,
+    COMBINEFUNC = quantile_combine_int64,
+    SERIALFUNC = quantile_serialize_int64,
+    DESERIALFUNC = quantile_deserialize_int64,
+    PARALLEL = SAFE
+);
+
+/* adding and removing values to/from the storable states (sliding windows) */
+CREATE OR REPLACE FUNCTION quantile_state_add(p_state quantile_state_double, p_values double precision[])
+    RETURNS quantile_state_double
+    AS 'quantile', 'quantile_state_add_double'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_state_remove(p_state quantile_state_double, p_values double precision[])
+    RETURNS quantile_state_double
+    AS 'quantile', 'quantile_state_remove_double'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_state_get(p_state quantile_state_double, p_quantiles double precision[])
+    RETURNS double precision[]
+    AS 'quantile', 'quantile_state_get_double'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_state_add(p_state quantile_state_numeric, p_values numeric[])
+    RETURNS quantile_state_numeric
+    AS 'quantile', 'quantile_state_add_numeric'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_state_remove(p_state quantile_state_numeric, p_values numeric[])
+    RETURNS quantile_state_numeric
+    AS 'quantile', 'quantile_state_remove_numeric'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_state_get(p_state quantile_state_numeric, p_quantiles double precision[])
+    RETURNS numeric[]
+    AS 'quantile', 'quantile_state_get_numeric'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_state_add(p_state quantile_state_int32, p_values int[])
+    RETURNS quantile_state_int32
+    AS 'quantile', 'quantile_state_add_int32'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_state_remove(p_state quantile_state_int32, p_values int[])
+    RETURNS quantile_state_int32
+    AS 'quantile', 'quantile_state_remove_int32'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_state_get(p_state quantile_state_int32, p_quantiles double precision[])
+    RETURNS int[]
+    AS 'quantile', 'quantile_state_get_int32'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_state_add(p_state quantile_state_int64, p_values bigint[])
+    RETURNS quantile_state_int64
+    AS 'quantile', 'quantile_state_add_int64'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_state_remove(p_state quantile_state_int64, p_values bigint[])
+    RETURNS quantile_state_int64
+    AS 'quantile', 'quantile_state_remove_int64'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_state_get(p_state quantile_state_int64, p_quantiles double precision[])
+    RETURNS bigint[]
+    AS 'quantile', 'quantile_state_get_int64'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+/* quantiles of distinct values (deduplicated while accumulating) */
+CREATE OR REPLACE FUNCTION quantile_distinct_append_double(p_pointer internal, p_element double precision, p_quantiles double precision[])
+    RETURNS internal
+    AS 'quantile', 'quantile_distinct_append_double'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_distinct_double(p_pointer internal)
+    RETURNS double precision[]
+    AS 'quantile', 'quantile_distinct_double'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_distinct(double precision, double precision[]) (
+    SFUNC = quantile_distinct_append_double,
+    STYPE = internal,
+    FINALFUNC = quantile_distinct_double,
+    COMBINEFUNC = quantile_combine_double,
+    SERIALFUNC = quantile_serialize_double,
+    DESERIALFUNC = quantile_deserialize_double,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION quantile_distinct_append_numeric(p_pointer internal, p_element numeric, p_quantiles double precision[])
+    RETURNS internal
+    AS 'quantile', 'quantile_distinct_append_numeric'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_distinct_numeric(p_pointer internal)
+    RETURNS numeric[]
+    AS 'quantile', 'quantile_distinct_numeric'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_distinct(numeric, double precision[]) (
+    SFUNC = quantile_distinct_append_numeric,
+    STYPE = internal,
+    FINALFUNC = quantile_distinct_numeric,
+    COMBINEFUNC = quantile_combine_numeric,
+    SERIALFUNC = quantile_serialize_numeric,
+    DESERIALFUNC = quantile_deserialize_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION quantile_distinct_append_int32(p_pointer internal, p_element int, p_quantiles double precision[])
+    RETURNS internal
+    AS 'quantile', 'quantile_distinct_append_int32'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_distinct_int32(p_pointer internal)
+    RETURNS int[]
+    AS 'quantile', 'quantile_distinct_int32'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_distinct(int, double precision[]) (
+    SFUNC = quantile_distinct_append_int32,
+    STYPE = internal,
+    FINALFUNC = quantile_distinct_int32,
+    COMBINEFUNC = quantile_combine_int32,
+    SERIALFUNC = quantile_serialize_int32,
+    DESERIALFUNC = quantile_deserialize_int32,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION quantile_distinct_append_int64(p_pointer internal, p_element bigint, p_quantiles double precision[])
+    RETURNS internal
+    AS 'quantile', 'quantile_distinct_append_int64'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_distinct_int64(p_pointer internal)
+    RETURNS bigint[]
+    AS 'quantile', 'quantile_distinct_int64'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_distinct(bigint, double precision[]) (
+    SFUNC = quantile_distinct_append_int64,
+    STYPE = internal,
+    FINALFUNC = quantile_distinct_int64,
+    COMBINEFUNC = quantile_combine_int64,
+    SERIALFUNC = quantile_serialize_int64,
+    DESERIALFUNC = quantile_deserialize_int64,
+    PARALLEL = SAFE
+);
+
+/* quantiles of multiple columns at once */
+CREATE OR REPLACE FUNCTION quantile_columns_append(p_pointer internal, p_values double precision[], p_quantiles double precision[])
+    RETURNS internal
+    AS 'quantile', 'quantile_columns_append'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_columns_final(p_pointer internal)
+    RETURNS double precision[]
+    AS 'quantile', 'quantile_columns_final'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_columns_combine(p_pointer internal, p_pointer2 internal)
+    RETURNS internal
+    AS 'quantile', 'quantile_columns_combine'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_columns_serialize(p_pointer internal)
+    RETURNS bytea
+    AS 'quantile', 'quantile_columns_serialize'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_columns_deserialize(p_value bytea, p_pointer internal)
+    RETURNS internal
+    AS 'quantile', 'quantile_columns_deserialize'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_columns(double precision[], double precision[]) (
+    SFUNC = quantile_columns_append,
+    STYPE = internal,
+    FINALFUNC = quantile_columns_final,
+    COMBINEFUNC = quantile_columns_combine,
+    SERIALFUNC = quantile_columns_serialize,
+    DESERIALFUNC = quantile_columns_deserialize,
+    PARALLEL = SAFE
+);
+
+/* storable Greenwald-Khanna sketches, e.g. one per range of heap blocks */
+CREATE TYPE quantile_sketch_double;
+
+CREATE OR REPLACE FUNCTION quantile_sketch_double_in(cstring)
+    RETURNS quantile_sketch_double
+    AS 'byteain'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_sketch_double_out(quantile_sketch_double)
+    RETURNS cstring
+    AS 'byteaout'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_sketch_double_recv(internal)
+    RETURNS quantile_sketch_double
+    AS 'bytearecv'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_sketch_double_send(quantile_sketch_double)
+    RETURNS bytea
+    AS 'byteasend'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE TYPE quantile_sketch_double (
+    INPUT = quantile_sketch_double_in,
+    OUTPUT = quantile_sketch_double_out,
+    RECEIVE = quantile_sketch_double_recv,
+    SEND = quantile_sketch_double_send,
+    INTERNALLENGTH = VARIABLE,
+    STORAGE = extended
+);
+
+CREATE OR REPLACE FUNCTION quantile_eps_append_double(p_pointer internal, p_element double precision, p_epsilon double precision)
+    RETURNS internal
+    AS 'quantile', 'quantile_eps_append_double'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_sketch_agg_double(p_pointer internal)
+    RETURNS quantile_sketch_double
+    AS 'quantile', 'quantile_sketch_final'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_sketch_agg(double precision, double precision) (
+    SFUNC = quantile_eps_append_double,
+    STYPE = internal,
+    FINALFUNC = quantile_sketch_agg_double,
+    COMBINEFUNC = quantile_eps_combine,
+    SERIALFUNC = quantile_eps_serialize,
+    DESERIALFUNC = quantile_eps_deserialize,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION quantile_sketch_merge_append_double(p_pointer internal, p_sketch quantile_sketch_double)
+    RETURNS internal
+    AS 'quantile', 'quantile_sketch_merge_append_double'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_sketch_merge_append_double(p_pointer internal, p_sketch quantile_sketch_double, p_quantiles double precision[])
+    RETURNS internal
+    AS 'quantile', 'quantile_sketch_merge_append_double'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_sketch_merge(quantile_sketch_double) (
+    SFUNC = quantile_sketch_merge_append_double,
+    STYPE = internal,
+    FINALFUNC = quantile_sketch_agg_double,
+    COMBINEFUNC = quantile_eps_combine,
+    SERIALFUNC = quantile_eps_serialize,
+    DESERIALFUNC = quantile_eps_deserialize,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE quantile_sketch_merge(quantile_sketch_double, double precision[]) (
+    SFUNC = quantile_sketch_merge_append_double,
+    STYPE = internal,
+    FINALFUNC = quantile_eps_double,
+    COMBINEFUNC = quantile_eps_combine,
+    SERIALFUNC = quantile_eps_serialize,
+    DESERIALFUNC = quantile_eps_deserialize,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION quantile_sketch_combine(p_sketch1 quantile_sketch_double, p_sketch2 quantile_sketch_double)
+    RETURNS quantile_sketch_double
+    AS 'quantile', 'quantile_sketch_combine_double'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE TYPE quantile_sketch_numeric;
+
+CREATE OR REPLACE FUNCTION quantile_sketch_numeric_in(cstring)
+    RETURNS quantile_sketch_numeric
+    AS 'byteain'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_sketch_numeric_out(quantile_sketch_numeric)
+    RETURNS cstring
+    AS 'byteaout'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_sketch_numeric_recv(internal)
+    RETURNS quantile_sketch_numeric
+    AS 'bytearecv'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_sketch_numeric_send(quantile_sketch_numeric)
+    RETURNS bytea
+    AS 'byteasend'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE TYPE quantile_sketch_numeric (
+    INPUT = quantile_sketch_numeric_in,
+    OUTPUT = quantile_sketch_numeric_out,
+    RECEIVE = quantile_sketch_numeric_recv,
+    SEND = quantile_sketch_numeric_send,
+    INTERNALLENGTH = VARIABLE,
+    STORAGE = extended
+);
+
+CREATE OR REPLACE FUNCTION quantile_eps_append_numeric(p_pointer internal, p_element numeric, p_epsilon double precision)
+    RETURNS internal
+    AS 'quantile', 'quantile_eps_append_numeric'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_sketch_agg_numeric(p_pointer internal)
+    RETURNS quantile_sketch_numeric
+    AS 'quantile', 'quantile_sketch_final'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_sketch_agg(numeric, double precision) (
+    SFUNC = quantile_eps_append_numeric,
+    STYPE = internal,
+    FINALFUNC = quantile_sketch_agg_numeric,
+    COMBINEFUNC = quantile_eps_combine,
+    SERIALFUNC = quantile_eps_serialize,
+    DESERIALFUNC = quantile_eps_deserialize,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION quantile_sketch_merge_append_numeric(p_pointer internal, p_sketch quantile_sketch_numeric)
+    RETURNS internal
+    AS 'quantile', 'quantile_sketch_merge_append_numeric'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_sketch_merge_append_numeric(p_pointer internal, p_sketch quantile_sketch_numeric, p_quantiles double precision[])
+    RETURNS internal
+    AS 'quantile', 'quantile_sketch_merge_append_numeric'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_sketch_merge(quantile_sketch_numeric) (
+    SFUNC = quantile_sketch_merge_append_numeric,
+    STYPE = internal,
+    FINALFUNC = quantile_sketch_agg_numeric,
+    COMBINEFUNC = quantile_eps_combine,
+    SERIALFUNC = quantile_eps_serialize,
+    DESERIALFUNC = quantile_eps_deserialize,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE quantile_sketch_merge(quantile_sketch_numeric, double precision[]) (
+    SFUNC = quantile_sketch_merge_append_numeric,
+    STYPE = internal,
+    FINALFUNC = quantile_eps_numeric,
+    COMBINEFUNC = quantile_eps_combine,
+    SERIALFUNC = quantile_eps_serialize,
+    DESERIALFUNC = quantile_eps_deserialize,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION quantile_sketch_combine(p_sketch1 quantile_sketch_numeric, p_sketch2 quantile_sketch_numeric)
+    RETURNS quantile_sketch_numeric
+    AS 'quantile', 'quantile_sketch_combine_numeric'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE TYPE quantile_sketch_int32;
+
+CREATE OR REPLACE FUNCTION quantile_sketch_int32_in(cstring)
+    RETURNS quantile_sketch_int32
+    AS 'byteain'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_sketch_int32_out(quantile_sketch_int32)
+    RETURNS cstring
+    AS 'byteaout'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_sketch_int32_recv(internal)
+    RETURNS quantile_sketch_int32
+    AS 'bytearecv'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_sketch_int32_send(quantile_sketch_int32)
+    RETURNS bytea
+    AS 'byteasend'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE TYPE quantile_sketch_int32 (
+    INPUT = quantile_sketch_int32_in,
+    OUTPUT = quantile_sketch_int32_out,
+    RECEIVE = quantile_sketch_int32_recv,
+    SEND = quantile_sketch_int32_send,
+    INTERNALLENGTH = VARIABLE,
+    STORAGE = extended
+);
+
+CREATE OR REPLACE FUNCTION quantile_eps_append_int32(p_pointer internal, p_element int, p_epsilon double precision)
+    RETURNS internal
+    AS 'quantile', 'quantile_eps_append_int32'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_sketch_agg_int32(p_pointer internal)
+    RETURNS quantile_sketch_int32
+    AS 'quantile', 'quantile_sketch_final'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_sketch_agg(int, double precision) (
+    SFUNC = quantile_eps_append_int32,
+    STYPE = internal,
+    FINALFUNC = quantile_sketch_agg_int32,
+    COMBINEFUNC = quantile_eps_combine,
+    SERIALFUNC = quantile_eps_serialize,
+    DESERIALFUNC = quantile_eps_deserialize,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION quantile_sketch_merge_append_int32(p_pointer internal, p_sketch quantile_sketch_int32)
+    RETURNS internal
+    AS 'quantile', 'quantile_sketch_merge_append_int32'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_sketch_merge_append_int32(p_pointer internal, p_sketch quantile_sketch_int32, p_quantiles double precision[])
+    RETURNS internal
+    AS 'quantile', 'quantile_sketch_merge_append_int32'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_sketch_merge(quantile_sketch_int32) (
+    SFUNC = quantile_sketch_merge_append_int32,
+    STYPE = internal,
+    FINALFUNC = quantile_sketch_agg_int32,
+    COMBINEFUNC = quantile_eps_combine,
+    SERIALFUNC = quantile_eps_serialize,
+    DESERIALFUNC = quantile_eps_deserialize,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE quantile_sketch_merge(quantile_sketch_int32, double precision[]) (
+    SFUNC = quantile_sketch_merge_append_int32,
+    STYPE = internal,
+    FINALFUNC = quantile_eps_int32,
+    COMBINEFUNC = quantile_eps_combine,
+    SERIALFUNC = quantile_eps_serialize,
+    DESERIALFUNC = quantile_eps_deserialize,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION quantile_sketch_combine(p_sketch1 quantile_sketch_int32, p_sketch2 quantile_sketch_int32)
+    RETURNS quantile_sketch_int32
+    AS 'quantile', 'quantile_sketch_combine_int32'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE TYPE quantile_sketch_int64;
+
+CREATE OR REPLACE FUNCTION quantile_sketch_int64_in(cstring)
+    RETURNS quantile_sketch_int64
+    AS 'byteain'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_sketch_int64_out(quantile_sketch_int64)
+    RETURNS cstring
+    AS 'byteaout'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_sketch_int64_recv(internal)
+    RETURNS quantile_sketch_int64
+    AS 'bytearecv'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_sketch_int64_send(quantile_sketch_int64)
+    RETURNS bytea
+    AS 'byteasend'
+    LANGUAGE internal IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE TYPE quantile_sketch_int64 (
+    INPUT = quantile_sketch_int64_in,
+    OUTPUT = quantile_sketch_int64_out,
+    RECEIVE = quantile_sketch_int64_recv,
+    SEND = quantile_sketch_int64_send,
+    INTERNALLENGTH = VARIABLE,
+    STORAGE = extended
+);
+
+CREATE OR REPLACE FUNCTION quantile_eps_append_int64(p_pointer internal, p_element bigint, p_epsilon double precision)
+    RETURNS internal
+    AS 'quantile', 'quantile_eps_append_int64'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_sketch_agg_int64(p_pointer internal)
+    RETURNS quantile_sketch_int64
+    AS 'quantile', 'quantile_sketch_final'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_sketch_agg(bigint, double precision) (
+    SFUNC = quantile_eps_append_int64,
+    STYPE = internal,
+    FINALFUNC = quantile_sketch_agg_int64,
+    COMBINEFUNC = quantile_eps_combine,
+    SERIALFUNC = quantile_eps_serialize,
+    DESERIALFUNC = quantile_eps_deserialize,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION quantile_sketch_merge_append_int64(p_pointer internal, p_sketch quantile_sketch_int64)
+    RETURNS internal
+    AS 'quantile', 'quantile_sketch_merge_append_int64'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_sketch_merge_append_int64(p_pointer internal, p_sketch quantile_sketch_int64, p_quantiles double precision[])
+    RETURNS internal
+    AS 'quantile', 'quantile_sketch_merge_append_int64'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_sketch_merge(quantile_sketch_int64) (
+    SFUNC = quantile_sketch_merge_append_int64,
+    STYPE = internal,
+    FINALFUNC = quantile_sketch_agg_int64,
+    COMBINEFUNC = quantile_eps_combine,
+    SERIALFUNC = quantile_eps_serialize,
+    DESERIALFUNC = quantile_eps_deserialize,
+    PARALLEL = SAFE
+);
+
+CREATE AGGREGATE quantile_sketch_merge(quantile_sketch_int64, double precision[]) (
+    SFUNC = quantile_sketch_merge_append_int64,
+    STYPE = internal,
+    FINALFUNC = quantile_eps_int64,
+    COMBINEFUNC = quantile_eps_combine,
+    SERIALFUNC = quantile_eps_serialize,
+    DESERIALFUNC = quantile_eps_deserialize,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION quantile_sketch_combine(p_sketch1 quantile_sketch_int64, p_sketch2 quantile_sketch_int64)
+    RETURNS quantile_sketch_int64
+    AS 'quantile', 'quantile_sketch_combine_int64'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_block_range(p_tid tid, p_pages_per_range int DEFAULT 128)
+    RETURNS bigint
+    AS 'quantile', 'quantile_block_range'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+/* robust statistics (median, IQR, MAD, trimmed mean) from a single state */
+CREATE TYPE quantile_robust_stats_result AS (median double precision, iqr double precision, mad double precision, trimmed_mean double precision);
+
+CREATE OR REPLACE FUNCTION quantile_robust_stats_double(p_pointer internal)
+    RETURNS quantile_robust_stats_result
+    AS 'quantile', 'quantile_robust_stats_double'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_robust_stats(double precision) (
+    SFUNC = quantile_state_agg_append_double,
+    STYPE = internal,
+    FINALFUNC = quantile_robust_stats_double,
+    COMBINEFUNC = quantile_combine_double,
+    SERIALFUNC = quantile_serialize_double,
+    DESERIALFUNC = quantile_deserialize_double,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION quantile_robust_stats(p_state quantile_state_double)
+    RETURNS quantile_robust_stats_result
+    AS 'quantile', 'quantile_state_robust_stats_double'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_robust_stats_numeric(p_pointer internal)
+    RETURNS quantile_robust_stats_result
+    AS 'quantile', 'quantile_robust_stats_numeric'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_robust_stats(numeric) (
+    SFUNC = quantile_state_agg_append_numeric,
+    STYPE = internal,
+    FINALFUNC = quantile_robust_stats_numeric,
+    COMBINEFUNC = quantile_combine_numeric,
+    SERIALFUNC = quantile_serialize_numeric,
+    DESERIALFUNC = quantile_deserialize_numeric,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION quantile_robust_stats(p_state quantile_state_numeric)
+    RETURNS quantile_robust_stats_result
+    AS 'quantile', 'quantile_state_robust_stats_numeric'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_robust_stats_int32(p_pointer internal)
+    RETURNS quantile_robust_stats_result
+    AS 'quantile', 'quantile_robust_stats_int32'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_robust_stats(int) (
+    SFUNC = quantile_state_agg_append_int32,
+    STYPE = internal,
+    FINALFUNC = quantile_robust_stats_int32,
+    COMBINEFUNC = quantile_combine_int32,
+    SERIALFUNC = quantile_serialize_int32,
+    DESERIALFUNC = quantile_deserialize_int32,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION quantile_robust_stats(p_state quantile_state_int32)
+    RETURNS quantile_robust_stats_result
+    AS 'quantile', 'quantile_state_robust_stats_int32'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION quantile_robust_stats_int64(p_pointer internal)
+    RETURNS quantile_robust_stats_result
+    AS 'quantile', 'quantile_robust_stats_int64'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE AGGREGATE quantile_robust_stats(bigint) (
+    SFUNC = quantile_state_agg_append_int64,
+    STYPE = internal,
+    FINALFUNC = quantile_robust_stats_int64,
+    COMBINEFUNC = quantile_combine_int64,
+    SERIALFUNC = quantile_serialize_int64,
+    DESERIALFUNC = quantile_deserialize_int64,
+    PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION quantile_robust_stats(p_state quantile_state_int64)
+    RETURNS quantile_robust_stats_result
+    AS 'quantile', 'quantile_state_robust_stats_int64'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
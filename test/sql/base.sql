@@ -2,7 +2,7 @@
 
 -- disable the notices for the create script (shell types etc.)
 SET client_min_messages = 'WARNING';
-\i sql/quantile--1.1.8.sql
+\i sql/quantile--1.2.0.sql
 SET client_min_messages = 'NOTICE';
 
 \set ECHO all
@@ -98,3 +98,223 @@ SELECT quantile(val, array[0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8, 0.9]) FROM (S
 SELECT quantile(val::bigint, array[0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8, 0.9]) FROM (SELECT val FROM child_table ORDER BY id) AS foo;
 SELECT quantile(val::double precision, array[0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8, 0.9]) FROM (SELECT val FROM child_table ORDER BY id) AS foo;
 SELECT quantile(val::numeric, array[0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8, 0.9]) FROM (SELECT val FROM child_table ORDER BY id) AS foo;
+
+-- spilling int64/double values to a temporary file
+SET quantile.spill_mem = 64;
+
+SELECT quantile(x::bigint, 0.5) FROM generate_series(1,100000) s(x);
+SELECT quantile(x::bigint, ARRAY[0, 0.1, 0.5, 0.99, 0.999, 1]) FROM generate_series(1,100000) s(x);
+SELECT quantile((x % 1000)::bigint, ARRAY[0, 0.1, 0.5, 0.99, 0.999, 1]) FROM generate_series(1,100000) s(x);
+SELECT quantile(x::double precision / 4, 0.5) FROM generate_series(-50000,49999) s(x);
+SELECT quantile(x::double precision / 4, ARRAY[0, 0.1, 0.5, 0.99, 0.999, 1]) FROM generate_series(-50000,49999) s(x);
+
+-- make sure the values really got spilled (and don't without the limit)
+CREATE FUNCTION temp_blocks_written(p_query text) RETURNS bigint AS $$
+DECLARE
+    v_plan json;
+BEGIN
+    EXECUTE 'EXPLAIN (ANALYZE, BUFFERS, FORMAT JSON) ' || p_query INTO v_plan;
+    RETURN (v_plan->0->'Plan'->>'Temp Written Blocks')::bigint;
+END;
+$$ LANGUAGE plpgsql;
+SET work_mem = '64MB';
+SELECT temp_blocks_written('SELECT quantile(x::bigint, ARRAY[0.5, 0.99]) FROM generate_series(1,100000) s(x)') > 0 AS spilled;
+SELECT temp_blocks_written('SELECT quantile(x::double precision, 0.5) FROM generate_series(1,100000) s(x)') > 0 AS spilled;
+RESET quantile.spill_mem;
+SELECT temp_blocks_written('SELECT quantile(x::bigint, ARRAY[0.5, 0.99]) FROM generate_series(1,100000) s(x)') > 0 AS spilled;
+RESET work_mem;
+DROP FUNCTION temp_blocks_written(text);
+
+-- approximate quantiles with a guaranteed rank error
+SELECT quantile_eps(x, ARRAY[0, 0.25, 0.5, 0.9, 1], 0.01) FROM generate_series(1,1000) s(x);
+SELECT quantile_eps(x::bigint, ARRAY[0, 0.25, 0.5, 0.9, 1], 0.01) FROM generate_series(1,1000) s(x);
+SELECT quantile_eps(x::double precision, ARRAY[0, 0.25, 0.5, 0.9, 1], 0.01) FROM generate_series(1,1000) s(x);
+SELECT quantile_eps(x::numeric, ARRAY[0, 0.25, 0.5, 0.9, 1], 0.01) FROM generate_series(1,1000) s(x);
+SELECT quantile_eps(x, ARRAY[0.5], 0) FROM generate_series(1,1000) s(x);
+
+-- the rank error has to be within (epsilon * count) even for adversarial inputs
+CREATE TABLE eps_data (kind text, x bigint);
+INSERT INTO eps_data SELECT 'sorted', i FROM generate_series(1,20000) s(i);
+INSERT INTO eps_data SELECT 'reversed', 20001 - i FROM generate_series(1,20000) s(i);
+INSERT INTO eps_data SELECT 'zigzag', (CASE WHEN i % 2 = 0 THEN i ELSE 20001 - i END) FROM generate_series(1,20000) s(i);
+INSERT INTO eps_data SELECT 'blocks', (CASE WHEN (i / 1000) % 2 = 0 THEN i ELSE -i END) FROM generate_series(1,20000) s(i);
+INSERT INTO eps_data SELECT 'duplicates', i % 10 FROM generate_series(1,20000) s(i);
+
+WITH percentiles AS (SELECT array_agg(i / 100.0::float8 ORDER BY i) AS p FROM generate_series(0,100) s(i)),
+     approx AS (SELECT kind, eps, count(*) AS cnt, quantile_eps(x, (SELECT p FROM percentiles), eps) AS vals
+                  FROM eps_data, (VALUES (0.05::float8), (0.01), (0.001)) e(eps) GROUP BY kind, eps),
+     ranks AS (SELECT kind, x, min(rn) AS lo, max(rn) AS hi
+                 FROM (SELECT kind, x, row_number() OVER (PARTITION BY kind ORDER BY x) AS rn FROM eps_data) foo
+                GROUP BY kind, x)
+SELECT a.kind, a.eps, bool_and(greatest(r.lo - greatest(ceil(a.cnt * u.p), 1), greatest(ceil(a.cnt * u.p), 1) - r.hi) <= a.eps * a.cnt) AS within_bound
+  FROM approx a, LATERAL unnest((SELECT p FROM percentiles), a.vals) AS u(p, v), ranks r
+ WHERE r.kind = a.kind AND r.x = u.v
+ GROUP BY a.kind, a.eps ORDER BY a.kind, a.eps;
+
+DROP TABLE eps_data;
+
+-- rank (CDF) aggregates
+SELECT quantile_rank(x, ARRAY[100, 250, 999, 0, 2000]) FROM generate_series(1,1000) s(x);
+SELECT quantile_rank(x::bigint, ARRAY[100, 250, 999, 0, 2000]) FROM generate_series(1,1000) s(x);
+SELECT quantile_rank(x::double precision, ARRAY[100, 250.5, 999, 0, 2000]) FROM generate_series(1,1000) s(x);
+SELECT quantile_rank(x::numeric, ARRAY[100, 250.5, 999, 0, 2000]) FROM generate_series(1,1000) s(x);
+SELECT quantile_rank(x % 10, ARRAY[0, 4, 9]) FROM generate_series(1,1000) s(x);
+
+SELECT (r).quantiles, (r).ranks FROM (SELECT quantile_and_rank(x, ARRAY[0.5, 0.9], ARRAY[250, 750]) AS r FROM generate_series(1,1000) s(x)) foo;
+SELECT (r).quantiles, (r).ranks FROM (SELECT quantile_and_rank(x::bigint, ARRAY[0.5, 0.9], ARRAY[250, 750]) AS r FROM generate_series(1,1000) s(x)) foo;
+SELECT (r).quantiles, (r).ranks FROM (SELECT quantile_and_rank(x::double precision, ARRAY[0.5, 0.9], ARRAY[250, 750]) AS r FROM generate_series(1,1000) s(x)) foo;
+SELECT (r).quantiles, (r).ranks FROM (SELECT quantile_and_rank(x::numeric, ARRAY[0.5, 0.9], ARRAY[250, 750]) AS r FROM generate_series(1,1000) s(x)) foo;
+
+-- equi-depth histograms
+SELECT (b).boundaries, (b).counts FROM (SELECT quantile_buckets(x, 4) AS b FROM generate_series(1,1000) s(x)) foo;
+SELECT (b).boundaries, (b).counts FROM (SELECT quantile_buckets(x::bigint, 4) AS b FROM generate_series(1,1000) s(x)) foo;
+SELECT (b).boundaries, (b).counts FROM (SELECT quantile_buckets(x::double precision, 4) AS b FROM generate_series(1,1000) s(x)) foo;
+SELECT (b).boundaries, (b).counts FROM (SELECT quantile_buckets(x::numeric, 4) AS b FROM generate_series(1,1000) s(x)) foo;
+SELECT (b).boundaries, (b).counts FROM (SELECT quantile_buckets(x % 10, 3) AS b FROM generate_series(1,1000) s(x)) foo;
+SELECT (b).boundaries, (b).counts FROM (SELECT quantile_buckets(x % 2, 4) AS b FROM generate_series(1,1000) s(x)) foo;
+SELECT quantile_buckets(x, 0) FROM generate_series(1,1000) s(x);
+
+-- reservoir sampling
+SELECT (q).quantiles, (q).sample_count, (q).total_count FROM (SELECT quantile_sampled(x, ARRAY[0, 0.5, 0.9], 10000) AS q FROM generate_series(1,1000) s(x)) foo;
+SELECT (q).quantiles, (q).sample_count, (q).total_count FROM (SELECT quantile_sampled(x::bigint, ARRAY[0, 0.5, 0.9], 10000) AS q FROM generate_series(1,1000) s(x)) foo;
+SELECT (q).quantiles, (q).sample_count, (q).total_count FROM (SELECT quantile_sampled(x::double precision, ARRAY[0, 0.5, 0.9], 10000) AS q FROM generate_series(1,1000) s(x)) foo;
+SELECT (q).quantiles, (q).sample_count, (q).total_count FROM (SELECT quantile_sampled(x::numeric, ARRAY[0, 0.5, 0.9], 10000) AS q FROM generate_series(1,1000) s(x)) foo;
+SELECT (q).sample_count, (q).total_count, (q).quantiles[1] BETWEEN 40000 AND 60000 AS median_ok, (q).quantiles[2] BETWEEN 85000 AND 95000 AS p90_ok FROM (SELECT quantile_sampled(x, ARRAY[0.5, 0.9], 1000) AS q FROM generate_series(1,100000) s(x)) foo;
+SELECT quantile_sampled(x, ARRAY[0.5], 0) FROM generate_series(1,1000) s(x);
+
+-- quantiles of arrays
+SELECT quantile_array_agg(a, ARRAY[0, 0.5, 0.9, 1]) FROM (SELECT array_agg(x) AS a FROM generate_series(1,1000) s(x) GROUP BY x % 10) foo;
+SELECT quantile_array_agg(a::bigint[], ARRAY[0, 0.5, 0.9, 1]) FROM (SELECT array_agg(x) AS a FROM generate_series(1,1000) s(x) GROUP BY x % 10) foo;
+SELECT quantile_array_agg(a::double precision[], ARRAY[0, 0.5, 0.9, 1]) FROM (SELECT array_agg(x) AS a FROM generate_series(1,1000) s(x) GROUP BY x % 10) foo;
+SELECT quantile_array_agg(a, ARRAY[0, 0.5, 1]) FROM (VALUES (ARRAY[1, NULL, 3]), (NULL), (ARRAY[]::int[]), (ARRAY[2, 4])) v(a);
+
+SELECT array_quantile(ARRAY[5, 3, 9, 1, 7], ARRAY[0, 0.5, 0.9, 1]);
+SELECT array_quantile(ARRAY[5, 3, NULL, 1, 7]::bigint[], ARRAY[0, 0.5, 0.9, 1]);
+SELECT array_quantile(ARRAY[2.5, 0.5, 1.5]::double precision[], ARRAY[0.5]);
+SELECT array_quantile(ARRAY[]::int[], ARRAY[0.5]);
+
+-- parallel aggregation
+CREATE TABLE parallel_data (x bigint);
+INSERT INTO parallel_data SELECT i FROM generate_series(1,100000) s(i);
+ALTER TABLE parallel_data SET (parallel_workers = 4);
+ANALYZE parallel_data;
+SET parallel_setup_cost = 0;
+SET parallel_tuple_cost = 0;
+SET max_parallel_workers_per_gather = 4;
+
+EXPLAIN (COSTS OFF) SELECT quantile(x, ARRAY[0, 0.25, 0.5, 0.99, 1]) FROM parallel_data;
+SELECT quantile(x, ARRAY[0, 0.25, 0.5, 0.99, 1]) FROM parallel_data;
+SELECT quantile(x::int, 0.5), quantile(x::double precision, 0.5), quantile(x::numeric, 0.5) FROM parallel_data;
+SELECT x % 3 AS g, quantile(x, ARRAY[0.5, 0.9]) FROM parallel_data GROUP BY 1 ORDER BY 1;
+SELECT quantile_array_agg(ARRAY[x, -x], ARRAY[0, 0.5, 1]) FROM parallel_data;
+
+-- workers don't spill, the leader spills the combined runs
+SET quantile.spill_mem = 64;
+SELECT quantile(x, ARRAY[0, 0.25, 0.5, 0.99, 1]) FROM parallel_data;
+SELECT quantile_array_agg(ARRAY[x, -x], ARRAY[0, 0.5, 1]) FROM parallel_data;
+RESET quantile.spill_mem;
+
+RESET parallel_setup_cost;
+RESET parallel_tuple_cost;
+RESET max_parallel_workers_per_gather;
+DROP TABLE parallel_data;
+
+-- storable states (rollups)
+CREATE TABLE rollup_data AS SELECT i % 4 AS region, i % 20 AS host, i AS x FROM generate_series(1,1000) s(i);
+CREATE TABLE rollup_states AS SELECT region, host, quantile_state_agg(x::double precision) AS s_double, quantile_state_agg(x::numeric) AS s_numeric, quantile_state_agg(x::int) AS s_int32, quantile_state_agg(x::bigint) AS s_int64 FROM rollup_data GROUP BY region, host;
+
+SELECT region, quantile_merge(s_int64, ARRAY[0, 0.5, 0.9, 1]) FROM rollup_states GROUP BY ROLLUP(region) ORDER BY region;
+SELECT quantile_merge(s_double, ARRAY[0.1, 0.5]), quantile_merge(s_numeric, ARRAY[0.1, 0.5]), quantile_merge(s_int32, ARRAY[0.1, 0.5]) FROM rollup_states;
+SELECT quantile_merge(s, ARRAY[0.25, 0.75]) FROM (SELECT region, quantile_merge(s_int32) AS s FROM rollup_states GROUP BY region) r;
+SELECT quantile_merge(s_int64, ARRAY[0.5]) FROM rollup_states WHERE host > 100;
+SELECT quantile_merge(s_int32::text::quantile_state_int64, ARRAY[0.5]) FROM rollup_states;
+
+DROP TABLE rollup_states;
+DROP TABLE rollup_data;
+
+-- delta encoding of the stored states
+SELECT length(quantile_state_agg(i::bigint)::text) FROM generate_series(1,1000) s(i);
+SELECT quantile_merge('\x000000010000000100000003020202'::quantile_state_int32, ARRAY[0, 0.5, 1]);
+SELECT quantile_merge('\x000000010000000100000003060101'::quantile_state_int32, ARRAY[0, 0.5, 1]);
+SELECT quantile_merge('\x000000020000000100000003020202'::quantile_state_int32, ARRAY[0, 0.5, 1]);
+
+-- NaN sorts after all other values (including infinity)
+SELECT quantile(x, ARRAY[0, 0.5, 0.75, 1]) FROM (VALUES (1::double precision), ('NaN'), (3), ('Infinity'), ('-Infinity'), ('NaN'), (2)) v(x);
+SELECT quantile(x, 0.5) FROM (VALUES ('NaN'::double precision), ('NaN'), (1)) v(x);
+
+-- extreme quantiles (selected using a heap)
+SELECT quantile(i, 0.99), quantile(i::bigint, 0.001), quantile(i::double precision, 1.0), quantile(i::numeric, 0.01) FROM generate_series(1,1000) s(i);
+SELECT quantile(1001 - i, 0.999), quantile(1001 - i, 0.05) FROM generate_series(1,1000) s(i);
+
+-- adding and removing values to/from the storable states
+SELECT quantile_state_get(quantile_state_add(NULL, ARRAY[5, 1, 3, NULL, 2, 4]), ARRAY[0, 0.5, 1]);
+SELECT quantile_state_get(quantile_state_remove(quantile_state_add(quantile_state_agg(i::bigint), ARRAY[1001, 1002]::bigint[]), ARRAY[1, 2, 3]::bigint[]), ARRAY[0, 0.5, 1]) FROM generate_series(1,1000) s(i);
+SELECT quantile_state_get(quantile_state_add(quantile_state_agg(x), ARRAY[0.5, 2.5]), ARRAY[0, 0.5, 1]) FROM (VALUES (1.0), (2.0), (3.0)) v(x);
+SELECT quantile_state_get(quantile_state_remove(quantile_state_agg(x), ARRAY[1, 2]::double precision[]), ARRAY[0.5]) FROM (VALUES (1::double precision), (2)) v(x);
+SELECT quantile_state_remove(quantile_state_agg(x), ARRAY[4]::double precision[]) FROM (VALUES (1::double precision), (2)) v(x);
+
+-- quantiles of distinct values
+SELECT quantile_distinct(i % 10, ARRAY[0, 0.5, 0.95, 1]), quantile(DISTINCT i % 10, ARRAY[0, 0.5, 0.95, 1]) FROM generate_series(1,1000) s(i);
+SELECT quantile_distinct((i % 7)::numeric, ARRAY[0.5]), quantile_distinct((i % 7)::double precision, ARRAY[0.5]), quantile_distinct((i % 7)::bigint, ARRAY[0.5]) FROM generate_series(1,5000) s(i);
+SELECT quantile_distinct(x, ARRAY[0.5]) FROM (VALUES (NULL::int), (NULL)) v(x);
+
+-- quantiles of multiple columns
+SELECT quantile_columns(ARRAY[i, i * 2, NULL]::double precision[], ARRAY[0, 0.5, 1]) FROM generate_series(1,100) s(i);
+SELECT i % 2 AS g, quantile_columns(ARRAY[i, -i]::double precision[], ARRAY[0.5]) FROM generate_series(1,10) s(i) GROUP BY 1 ORDER BY 1;
+SELECT quantile_columns(CASE WHEN i < 3 THEN ARRAY[i] ELSE ARRAY[i, i] END::double precision[], ARRAY[0.5]) FROM generate_series(1,5) s(i);
+
+-- values sorted in blocks while accumulating
+SELECT quantile(x, ARRAY[0, 0.25, 0.5, 0.999, 1]), quantile(x::bigint, 0.5), quantile(x::double precision, 0.999), quantile(x::numeric, 0.25) FROM (SELECT (i * 7919) % 100003 AS x FROM generate_series(1,100000) s(i)) foo;
+
+-- sort algorithms (quantile.sort_method)
+SET quantile.sort_method = 'auto';
+SELECT quantile(x, ARRAY[0, 0.5, 1]), quantile(y::bigint, 0.3), quantile(x::double precision, 0.5), quantile(y, 0.999) FROM (SELECT (i * 7919) % 10007 AS x, i % 100 AS y FROM generate_series(1,10000) s(i)) foo;
+SELECT g, quantile(x, 0.5), quantile(x::bigint, 0.3), quantile(x::double precision, 0.999), quantile(x::numeric, 0.5), quantile(x, ARRAY[0, 0.5, 1]) FROM (SELECT i % 3 AS g, (i * 7919) % (1000 * (i % 3) + 101) - 500 AS x FROM generate_series(1,5000) s(i)) foo GROUP BY 1 ORDER BY 1;
+SET quantile.sort_method = 'qsort';
+SELECT quantile(x, ARRAY[0, 0.5, 1]), quantile(y::bigint, 0.3), quantile(x::double precision, 0.5), quantile(y, 0.999) FROM (SELECT (i * 7919) % 10007 AS x, i % 100 AS y FROM generate_series(1,10000) s(i)) foo;
+SELECT g, quantile(x, 0.5), quantile(x::bigint, 0.3), quantile(x::double precision, 0.999), quantile(x::numeric, 0.5), quantile(x, ARRAY[0, 0.5, 1]) FROM (SELECT i % 3 AS g, (i * 7919) % (1000 * (i % 3) + 101) - 500 AS x FROM generate_series(1,5000) s(i)) foo GROUP BY 1 ORDER BY 1;
+SET quantile.sort_method = 'counting';
+SELECT quantile(x, ARRAY[0, 0.5, 1]), quantile(y::bigint, 0.3), quantile(x::double precision, 0.5), quantile(y, 0.999) FROM (SELECT (i * 7919) % 10007 AS x, i % 100 AS y FROM generate_series(1,10000) s(i)) foo;
+SELECT g, quantile(x, 0.5), quantile(x::bigint, 0.3), quantile(x::double precision, 0.999), quantile(x::numeric, 0.5), quantile(x, ARRAY[0, 0.5, 1]) FROM (SELECT i % 3 AS g, (i * 7919) % (1000 * (i % 3) + 101) - 500 AS x FROM generate_series(1,5000) s(i)) foo GROUP BY 1 ORDER BY 1;
+SET quantile.sort_method = 'radix';
+SELECT quantile(x, ARRAY[0, 0.5, 1]), quantile(y::bigint, 0.3), quantile(x::double precision, 0.5), quantile(y, 0.999) FROM (SELECT (i * 7919) % 10007 AS x, i % 100 AS y FROM generate_series(1,10000) s(i)) foo;
+SELECT g, quantile(x, 0.5), quantile(x::bigint, 0.3), quantile(x::double precision, 0.999), quantile(x::numeric, 0.5), quantile(x, ARRAY[0, 0.5, 1]) FROM (SELECT i % 3 AS g, (i * 7919) % (1000 * (i % 3) + 101) - 500 AS x FROM generate_series(1,5000) s(i)) foo GROUP BY 1 ORDER BY 1;
+SET quantile.sort_method = 'select';
+SELECT quantile(x, ARRAY[0, 0.5, 1]), quantile(y::bigint, 0.3), quantile(x::double precision, 0.5), quantile(y, 0.999) FROM (SELECT (i * 7919) % 10007 AS x, i % 100 AS y FROM generate_series(1,10000) s(i)) foo;
+SELECT g, quantile(x, 0.5), quantile(x::bigint, 0.3), quantile(x::double precision, 0.999), quantile(x::numeric, 0.5), quantile(x, ARRAY[0, 0.5, 1]) FROM (SELECT i % 3 AS g, (i * 7919) % (1000 * (i % 3) + 101) - 500 AS x FROM generate_series(1,5000) s(i)) foo GROUP BY 1 ORDER BY 1;
+RESET quantile.sort_method;
+
+-- the sort algorithm actually used is reported at DEBUG1 level
+SET client_min_messages = 'debug1';
+SET quantile.sort_method = 'qsort';
+SELECT quantile(x, ARRAY[0.5, 0.9]), quantile(x::bigint, ARRAY[0.5, 0.9]) FROM (SELECT (i * 7919) % 1009 AS x FROM generate_series(1,2000) s(i)) foo;
+SET quantile.sort_method = 'counting';
+SELECT quantile(x, ARRAY[0.5, 0.9]), quantile(x::bigint, ARRAY[0.5, 0.9]) FROM (SELECT (i * 7919) % 1009 AS x FROM generate_series(1,2000) s(i)) foo;
+SET quantile.sort_method = 'radix';
+SELECT quantile(x, ARRAY[0.5, 0.9]), quantile(x::bigint, ARRAY[0.5, 0.9]) FROM (SELECT (i * 7919) % 1009 AS x FROM generate_series(1,2000) s(i)) foo;
+SET quantile.sort_method = 'auto';
+SELECT quantile(x, ARRAY[0.5, 0.9]), quantile(x::bigint, ARRAY[0.5, 0.9]) FROM (SELECT (i * 7919) % 1009 AS x FROM generate_series(1,2000) s(i)) foo;
+SELECT quantile(i, ARRAY[0.5, 0.9]), quantile(i::bigint, ARRAY[0.5, 0.9]) FROM generate_series(1,2000) s(i);
+RESET client_min_messages;
+RESET quantile.sort_method;
+
+-- storable sketches (per block range)
+SELECT quantile_sketch_merge(s, ARRAY[0, 1]), (quantile_sketch_merge(s, ARRAY[0.5]))[1] BETWEEN 490 AND 510 FROM (SELECT i % 4 AS g, quantile_sketch_agg(i, 0.01) AS s FROM generate_series(1,1000) s(i) GROUP BY 1) foo;
+SELECT quantile_sketch_merge(s, ARRAY[0, 1]), (quantile_sketch_merge(s, ARRAY[0.5]))[1] BETWEEN 490 AND 510 FROM (SELECT i % 4 AS g, quantile_sketch_agg(i::bigint, 0.01) AS s FROM generate_series(1,1000) s(i) GROUP BY 1) foo;
+SELECT quantile_sketch_merge(s, ARRAY[0, 1]), (quantile_sketch_merge(s, ARRAY[0.5]))[1] BETWEEN 490 AND 510 FROM (SELECT i % 4 AS g, quantile_sketch_agg(i::double precision, 0.01) AS s FROM generate_series(1,1000) s(i) GROUP BY 1) foo;
+SELECT quantile_sketch_merge(s, ARRAY[0, 1]), (quantile_sketch_merge(s, ARRAY[0.5]))[1] BETWEEN 490 AND 510 FROM (SELECT i % 4 AS g, quantile_sketch_agg(i::numeric, 0.01) AS s FROM generate_series(1,1000) s(i) GROUP BY 1) foo;
+SELECT quantile_sketch_merge(s, ARRAY[0, 1]) FROM (SELECT quantile_sketch_merge(s) AS s FROM (SELECT i % 4 AS g, quantile_sketch_agg(i, 0.01) AS s FROM generate_series(1,1000) s(i) GROUP BY 1) foo) bar;
+SELECT quantile_sketch_merge(quantile_sketch_combine(a, b), ARRAY[0, 1]), quantile_sketch_combine(NULL::quantile_sketch_int64, NULL) IS NULL FROM (SELECT quantile_sketch_agg(i::bigint, 0.01) FILTER (WHERE i <= 50) AS a, quantile_sketch_agg(i::bigint, 0.01) FILTER (WHERE i > 50) AS b FROM generate_series(1,100) s(i)) foo;
+SELECT quantile_sketch_merge(quantile_sketch_combine(s, NULL), ARRAY[0, 1]) FROM (SELECT quantile_sketch_agg(i, 0.01) AS s FROM generate_series(1,10) s(i)) foo;
+SELECT quantile_sketch_agg(i, 0.01) IS NULL FROM generate_series(1,10) s(i) WHERE i > 10;
+SELECT quantile_block_range('(1000,3)'::tid), quantile_block_range('(1000,3)'::tid, 10);
+SELECT quantile_block_range('(1,1)'::tid, 0);
+SELECT quantile_sketch_agg(i, 0) FROM generate_series(1,10) s(i);
+SELECT quantile_sketch_merge('\x00000002'::quantile_sketch_int32);
+
+-- robust statistics
+SELECT (quantile_robust_stats(i)).* FROM generate_series(1,100) s(i);
+SELECT (quantile_robust_stats(x)).* FROM (SELECT i % 10 AS x FROM generate_series(1,1000) s(i) UNION ALL SELECT 1000 FROM generate_series(1,20)) foo;
+SELECT (quantile_robust_stats(x::bigint)).*, quantile_robust_stats(x::double precision) = quantile_robust_stats(x::numeric) FROM (SELECT (i * 7919) % 10007 AS x FROM generate_series(1,10000) s(i)) foo;
+SELECT (quantile_robust_stats(quantile_state_agg(x))).* FROM (VALUES (1.5), (2.5), (10.0)) v(x);
+SELECT quantile_robust_stats(x) IS NULL FROM (VALUES (NULL::int)) v(x);
@@ -0,0 +1,46 @@
+-- upgrade from 1.1.8 (the upgrade updates the catalogs directly, to make
+-- the quantile aggregates parallel safe)
+CREATE SCHEMA quantile_upgrade;
+SET search_path = quantile_upgrade;
+SET client_min_messages = 'WARNING';
+CREATE EXTENSION quantile VERSION '1.1.8' SCHEMA quantile_upgrade;
+ALTER EXTENSION quantile UPDATE;
+RESET client_min_messages;
+
+SELECT extversion FROM pg_extension WHERE extname = 'quantile';
+
+SELECT p.oid::regprocedure, p.proparallel, a.aggcombinefn, a.aggserialfn, a.aggdeserialfn
+  FROM pg_proc p JOIN pg_aggregate a ON (a.aggfnoid = p.oid)
+ WHERE p.pronamespace = 'quantile_upgrade'::regnamespace AND p.proname = 'quantile'
+ ORDER BY p.oid::regprocedure::text COLLATE "C";
+
+SELECT quantile(x, 0.5), quantile(x::bigint, ARRAY[0.1, 0.9]) FROM generate_series(1,1000) s(x);
+
+-- the upgraded extension should match a fresh install of the same version
+CREATE TEMP VIEW quantile_objects AS
+SELECT format('%s %s %s %s %s %s %s %s %s %s %s', p.oid::regprocedure, p.prorettype::regtype,
+              p.provolatile, p.proisstrict, p.proparallel, a.aggtransfn, a.aggtranstype::regtype,
+              a.aggfinalfn, a.aggcombinefn, a.aggserialfn, a.aggdeserialfn) AS object
+  FROM pg_proc p LEFT JOIN pg_aggregate a ON (a.aggfnoid = p.oid)
+ WHERE p.pronamespace = 'quantile_upgrade'::regnamespace
+UNION ALL
+SELECT format('%s %s %s %s %s %s', t.typname, t.typtype, t.typinput, t.typoutput, t.typreceive, t.typsend)
+  FROM pg_type t
+ WHERE t.typnamespace = 'quantile_upgrade'::regnamespace
+UNION ALL
+SELECT format('%s.%s %s', c.relname, a.attname, format_type(a.atttypid, a.atttypmod))
+  FROM pg_attribute a JOIN pg_class c ON (a.attrelid = c.oid)
+ WHERE c.relnamespace = 'quantile_upgrade'::regnamespace AND a.attnum > 0;
+
+CREATE TEMP TABLE quantile_upgraded AS SELECT * FROM quantile_objects;
+
+DROP EXTENSION quantile;
+CREATE EXTENSION quantile SCHEMA quantile_upgrade;
+
+(SELECT * FROM quantile_objects EXCEPT SELECT * FROM quantile_upgraded)
+UNION ALL
+(SELECT * FROM quantile_upgraded EXCEPT SELECT * FROM quantile_objects);
+
+DROP EXTENSION quantile;
+DROP SCHEMA quantile_upgrade;
+RESET search_path;